@@ -14,11 +14,12 @@ struct audio {
     SDL_AudioDeviceID device;
     double_t wave_position;
     double_t wave_increment;
-    uint8_t buffer[AUDIO_SAMPLES_PER_FRAME * 30];
-} __attribute__((aligned(128)));
+};
 
 struct audio* audio_create(void);
 int32_t audio_init(struct audio* audio);
 void audio_beep(struct audio* audio, int32_t len);
-void audio_sine(struct audio* audio, int32_t len);
+// drops whatever is still queued
+void audio_stop(struct audio* audio);
+void audio_sine(struct audio* audio, uint8_t* buffer, int32_t len);
 void audio_destroy(struct audio* audio);
@@ -0,0 +1,98 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+#define BATCH_LANES 32
+#define BATCH_HALF (BATCH_LANES / 2)
+
+// one AVX2 register each. 16 bit fields are split in two halves, lanes
+// 0-15 and 16-31, since wider vectors are lowered element by element.
+typedef uint8_t batch_u8 __attribute__((vector_size(BATCH_LANES)));
+typedef uint16_t batch_u16 __attribute__((vector_size(BATCH_LANES)));
+
+/*
+runs up to BATCH_LANES instances of the same ROM in lockstep. registers,
+I, PC and timers live here in structure of arrays form, one vector lane per
+instance, while memory, display, stack and keys stay in the instances.
+
+every step groups the lanes by PC and opcode. register only instructions
+(6XNN, 7XNN, 8XYN, skips, jumps, ANNN, EX9E, EXA1, FX07, FX15, FX18, FX1E,
+FX29) and FX65 run on all lanes of a group at once. anything else touching
+memory, the display, the stack or the rng drops to cpu_emulate_cycle lane by
+lane, copying only the registers that instruction reads or writes.
+diverged lanes rejoin as soon as they reach the same PC again. when the lanes
+average fewer than 8 per group, e.g. because they branch on their own keys,
+grouping costs more than it saves. they then run one by one with
+cpu_emulate_cycle, and are grouped again once enough of them share a PC at
+the start of a batch_run, checked less often the more often they split.
+
+all lanes run in the same mode. SUPER-CHIP's BXNN takes the scalar path
+too. XO-CHIP lanes always run one by one, as its skips, long I loads and
+64 KB pages leave too little for the vectors to win.
+
+measured with chip8-bench, this is at best 1.2-1.4x the scalar loop on
+register heavy ROMs, since DXYN, FX55 and FX33 stay scalar. ROMs whose
+lanes branch on their own keys or rng run split and match a scalar loop
+that also steps every instance a frame at a time.
+
+all lanes run on one virtual clock, taken from the first instance. the
+timers hold their values as of timer_ticks and are only brought up to date
+when FX07, FX15 or FX18 runs, so frames cost nothing extra.
+*/
+struct batch {
+    batch_u8 v[16];
+    batch_u16 i[2];
+    batch_u16 pc[2];
+    batch_u8 dt;
+    batch_u8 st;
+
+    // pressed[k] has lanes holding key k set, loaded by batch_run
+    batch_u8 pressed[16];
+    bool pressed_loaded;
+
+    struct cpu* cpu[BATCH_LANES];
+    // bit / 0xFF byte for every lane in use
+    uint32_t active;
+    batch_u8 lanes;
+
+    // pages holding the same bytes in every lane, so code fetched from
+    // them is the same for all lanes
+    uint16_t shared_pages;
+
+    // as in the instances, see cpu_set_mode
+    uint16_t memory_mask;
+    uint8_t page_shift;
+    uint8_t mode;
+
+    // lanes too far apart to group run one by one, with the registers left
+    // in the instances, see batch_run
+    bool split;
+    // batch_runs to stay split before trying to group again, doubled every
+    // time grouping is given up so lanes that keep diverging stop paying
+    // for it
+    uint8_t rejoin_wait;
+    uint8_t rejoin_after;
+
+    // see cpu->cycles
+    uint64_t cycles;
+    uint64_t timer_ticks;
+    uint32_t clock_rate;
+
+    // lane instructions executed vectorised and one by one
+    uint64_t vector_cycles;
+    uint64_t scalar_cycles;
+} __attribute__((aligned(64)));
+
+// takes over count instances. their registers are stale until batch_sync
+// and they must not be run on their own in the meantime. traced instances
+// only record the instructions that take the scalar path. fails if the
+// instances run in different modes.
+int32_t batch_init(struct batch* batch, struct cpu** cpus, uint32_t count);
+
+// keys are read from the instances, set them with cpu_set_key in between
+void batch_run(struct batch* batch, uint32_t cycles);
+
+// writes the registers back to the instances
+void batch_sync(struct batch* batch);
@@ -1,69 +1,232 @@
 #pragma once
 #include <stdbool.h>
 #include <stdint.h>
-#include <SDL2/SDL_events.h>
-
-#include "audio.h"
-#include "graphics.h"
-
-static const uint8_t chip8_fontset[80] = {
-    0xF0U, 0x90U, 0x90U, 0x90U, 0xF0U, // 0
-    0x20U, 0x60U, 0x20U, 0x20U, 0x70U, // 1
-    0xF0U, 0x10U, 0xF0U, 0x80U, 0xF0U, // 2
-    0xF0U, 0x10U, 0xF0U, 0x10U, 0xF0U, // 3
-    0x90U, 0x90U, 0xF0U, 0x10U, 0x10U, // 4
-    0xF0U, 0x80U, 0xF0U, 0x10U, 0xF0U, // 5
-    0xF0U, 0x80U, 0xF0U, 0x90U, 0xF0U, // 6
-    0xF0U, 0x10U, 0x20U, 0x40U, 0x40U, // 7
-    0xF0U, 0x90U, 0xF0U, 0x90U, 0xF0U, // 8
-    0xF0U, 0x90U, 0xF0U, 0x10U, 0xF0U, // 9
-    0xF0U, 0x90U, 0xF0U, 0x90U, 0x90U, // A
-    0xE0U, 0x90U, 0xE0U, 0x90U, 0xE0U, // B
-    0xF0U, 0x80U, 0x80U, 0x80U, 0xF0U, // C
-    0xE0U, 0x90U, 0x90U, 0x90U, 0xE0U, // D
-    0xF0U, 0x80U, 0xF0U, 0x80U, 0xF0U, // E
-    0xF0U, 0x80U, 0xF0U, 0x80U, 0x80U  // F
+
+#include "display.h"
+#include "mem.h"
+#include "pool.h"
+#include "rom.h"
+#include "trace.h"
+
+// default instructions per second, 10 per 60hz frame
+#define CPU_CLOCK_RATE 600
+
+// instruction sets, see cpu_set_mode
+enum cpu_mode {
+    CPU_CHIP8,
+    // SUPER-CHIP 1.1: 128x64 hires mode, scrolling, 16x16 sprites, the big
+    // font and flag registers. FX55 and FX65 leave I alone, BXNN jumps to
+    // XNN + VX and sprites are clipped at the edges.
+    CPU_SCHIP,
+    // XO-CHIP: SUPER-CHIP plus two bitplanes, 64 KB of memory, F000 NNNN,
+    // 5XY2, 5XY3 and audio patterns. quirks are those of CHIP-8 and
+    // sprites wrap around.
+    CPU_XOCHIP,
+    CPU_MODES,
 };
 
+/*
+instance layout, sized for hosting tens of thousands of VMs:
+    0x000-0x03F registers, stack and flags (one cache line)
+    0x040-0x0BF page table (16 pages, see mem.h)
+    0x0C0-0x13F per page hashes for cpu_state_hash
+    0x140-0x147 unhashed pages and rng
+    0x148-0x17F owning pool, trace ring, virtual clock, keys read, mode and
+                display writes
+    0x180-0x1B4 display, XO-CHIP planes, SUPER-CHIP flags and XO-CHIP audio
+a fresh instance costs 448 bytes. the font, ROM and a blank display are
+shared, so the other per-instance costs are a pooled display once the guest
+draws (2 KB) and a 264 byte pool page for every 256 byte page the guest
+writes to. forks share the display and pages until they write to them.
+*/
 struct cpu {
     // registers
     // 15 8bit general purpose registers named V0,V1->VE.
     // 16th register is used for the 'carry flag'
     uint8_t v[16];
-    uint16_t i : 12;
-    uint16_t pc : 12;
+    uint16_t stack[16];
+    // kept within memory_mask by cpu_emulate_cycle
+    uint16_t i;
+    uint16_t pc;
     uint8_t sp : 4;
 
-    // timers count at 60hz. when set above zero they will start counting down
-    uint8_t dt;
-    uint8_t st;
+    bool draw_flag;
+
+    // one bit per key of the 16 key hex keypad
+    uint16_t key;
+
+    // pages the instance may write in place / pages borrowed from the pool
+    uint16_t page_owned;
+    uint16_t page_pooled;
+
+    // pages written to since the last cpu_checkpoint
+    uint16_t page_dirty;
 
     /*
     memory map:
         0x000-0x1FF - Chip 8 interpreter (contains font set in emu)
-        0x050-0x0A0 - Used for the built in 4x5 pixel font set (0-F)
-        0x200-0xFFF - Program ROM and work RAM
+        0x000-0x04F - Used for the built in 4x5 pixel font set (0-F)
+        0x050-0x0EF - SUPER-CHIP 8x10 pixel font set (0-F)
+        0x200-0xFFF - Program ROM and work RAM, up to 0xFFFF on XO-CHIP
     */
-    uint8_t ram[4096];
-    uint16_t stack[16];
+    uint8_t* page[PAGE_COUNT];
+
+    // page_hash is only current for pages missing from page_unhashed
+    uint64_t page_hash[PAGE_COUNT];
+    uint16_t page_unhashed;
+
+    uint32_t rng;
+
+    struct cpu_pool* pool;
+
+    // when set, every executed instruction is recorded here, see trace.h
+    struct trace_ring* trace;
+
+    /*
+    virtual clock: instructions executed so far, run at clock_rate per
+    second. the timers count down at 60hz of this clock, so they are kept
+    as the tick they reach zero on and only worked out when read, see
+    cpu_dt and cpu_st. nobody has to tick them, and timing only depends on
+    the instructions executed, never on the host.
+    */
+    uint64_t cycles;
+    uint64_t dt_end;
+    uint64_t st_end;
+    uint32_t clock_rate;
+
+    // keys tested by SKP, SKNP or FX0A, cleared by whoever looks at it.
+    // see latency.h
+    uint16_t key_read;
+
+    // pages are 1 << page_shift bytes, addresses are masked with
+    // memory_mask. both follow from mode.
+    uint16_t memory_mask;
+    uint8_t page_shift;
+    uint8_t mode;
+
+    // bumped whenever the display may change, so watchers such as
+    // latency.h can tell without comparing it. wraps around.
+    uint32_t display_writes;
+
+    /*
+    read only outside the core. starts out as display_blank and is shared
+    copy on write like pages: display_pooled says it came from the pool,
+    display_owned that nobody else holds it. display_hash is only current
+    while display_unhashed is clear.
+    */
+    const struct display* display;
+    uint64_t display_hash;
+    bool display_pooled;
+    bool display_owned;
+    bool display_unhashed;
+
+    // XO-CHIP planes drawn to, bit n for plane n
+    uint8_t planes;
+
+    // SUPER-CHIP flag registers, FX75 and FX85
+    uint8_t flags[16];
 
-    bool key[16];
+    // XO-CHIP audio, F002 and FX3A. the tone plays either way.
+    uint8_t pattern[16];
+    uint8_t pitch;
+} __attribute__((aligned(64)));
+
+// instances and their private pages are allocated from a pool so that
+// creating and destroying them never touches malloc in steady state
+struct cpu_pool {
+    struct pool cpus;
+    struct pool pages;
+    struct pool large_pages;
+    struct pool displays;
+};
 
-    struct graphics* graphics;
-    struct audio* audio;
-} __attribute__((aligned(128)));
+int32_t cpu_pool_init(struct cpu_pool* pool, size_t instances_per_chunk);
 
+void cpu_pool_destroy(struct cpu_pool* pool);
 
-struct cpu* cpu_create(void);
+struct cpu* cpu_create(struct cpu_pool* pool);
 
-int32_t cpu_init(struct cpu* cpu);
+int32_t cpu_init(struct cpu* cpu, struct cpu_pool* pool);
 
 void cpu_emulate_cycle(struct cpu* cpu);
 
-void cpu_update_timers(struct cpu* cpu);
+// instructions per second of the virtual clock, the timers keep their
+// current values
+void cpu_set_clock(struct cpu* cpu, uint32_t clock_rate);
+
+// switches the instruction set, which resets memory and the display. call
+// it before cpu_load_application.
+void cpu_set_mode(struct cpu* cpu, uint8_t mode);
+
+// "chip8", "schip" or "xochip"
+const char* cpu_mode_name(uint8_t mode);
+// CPU_MODES if unknown
+uint8_t cpu_mode_from_name(const char* name);
+
+// maps the ROM into memory and starts a new checkpoint, false if it
+// doesn't fit the memory of the mode
+bool cpu_load_application(struct cpu* cpu, const struct rom* rom);
+
+// forgets which pages were written so far
+void cpu_checkpoint(struct cpu* cpu);
+
+// bitmask of pages written since the last checkpoint, walk it with
+// __builtin_ctz and read each page through cpu_page_data
+uint16_t cpu_dirty_pages(const struct cpu* cpu);
 
-bool cpu_load_application(struct cpu* cpu, const char* filename);
+const uint8_t* cpu_page_data(const struct cpu* cpu, uint32_t page);
 
-void cpu_handle_sdl_key_event(struct cpu* cpu, SDL_Event event);
+// drops every page that is clean in cpu but has a twin with the same
+// contents in other, and shares other's copy instead. both keep reading the
+// same bytes; the next write to such a page in either instance copies it.
+// returns the number of pages now shared.
+uint32_t cpu_share_clean_pages(struct cpu* cpu, struct cpu* other);
+
+// hash over registers, display and memory. only pages written since the
+// previous call are rehashed.
+uint64_t cpu_state_hash(struct cpu* cpu);
+
+void cpu_set_key(struct cpu* cpu, uint8_t key, bool pressed);
+
+// clones an instance into pool. the clone shares every page with cpu until
+// one of them writes to it, so forking costs one instance worth of memcpy.
+// pools may differ, e.g. one per thread, see explore.h. the clone is not
+// traced.
+struct cpu* cpu_fork(struct cpu* cpu, struct cpu_pool* pool);
+
+// CXNN draws from a per-instance generator so clones replay identically
+void cpu_seed(struct cpu* cpu, uint32_t seed);
 
 void cpu_destroy(struct cpu* cpu);
+
+// 60hz ticks of the virtual clock so far
+static inline uint64_t cpu_ticks(const struct cpu* cpu) {
+    return cpu->cycles * 60 / cpu->clock_rate;
+}
+
+static inline uint8_t cpu_dt(const struct cpu* cpu) {
+    const uint64_t ticks = cpu_ticks(cpu);
+    return cpu->dt_end > ticks ? (uint8_t)(cpu->dt_end - ticks) : 0;
+}
+
+// the tone plays while the sound timer is above zero
+static inline uint8_t cpu_st(const struct cpu* cpu) {
+    const uint64_t ticks = cpu_ticks(cpu);
+    return cpu->st_end > ticks ? (uint8_t)(cpu->st_end - ticks) : 0;
+}
+
+// the cycle the tone scheduled by the last FX18 stops on, at or before
+// cpu->cycles when silent
+static inline uint64_t cpu_sound_end(const struct cpu* cpu) {
+    return (cpu->st_end * cpu->clock_rate + 59) / 60;
+}
+
+static inline uint32_t cpu_page_size(const struct cpu* cpu) {
+    return 1U << cpu->page_shift;
+}
+
+static inline uint8_t cpu_peek(const struct cpu* cpu, uint16_t addr) {
+    addr &= cpu->memory_mask;
+    return cpu->page[addr >> cpu->page_shift]
+                    [addr & (cpu_page_size(cpu) - 1)];
+}
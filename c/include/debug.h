@@ -0,0 +1,118 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+#define DEBUG_MAX_POINTS 64
+#define DEBUG_MAX_CLAUSES 4
+
+enum debug_kind {
+    DEBUG_NONE,
+    // stops before the instruction at addr runs
+    DEBUG_BREAK,
+    // stops before FX65 or DXYN reads, or FX33 or FX55 writes, the range
+    DEBUG_READ,
+    DEBUG_WRITE,
+    DEBUG_ACCESS,
+};
+
+enum debug_operand_kind {
+    DEBUG_CONST,
+    DEBUG_V,
+    DEBUG_I,
+    DEBUG_PC,
+    DEBUG_DT,
+    DEBUG_ST,
+    DEBUG_RAM,
+};
+
+struct debug_operand {
+    uint8_t kind;
+    // register number for DEBUG_V
+    uint8_t reg;
+    // constant, or address for DEBUG_RAM
+    uint16_t value;
+};
+
+enum debug_compare {
+    DEBUG_EQ,
+    DEBUG_NE,
+    DEBUG_LT,
+    DEBUG_LE,
+    DEBUG_GT,
+    DEBUG_GE,
+};
+
+struct debug_clause {
+    struct debug_operand left;
+    struct debug_operand right;
+    uint8_t compare;
+};
+
+// holds when every clause does, always holds without clauses
+struct debug_condition {
+    struct debug_clause clauses[DEBUG_MAX_CLAUSES];
+    uint32_t count;
+};
+
+struct debug_point {
+    uint8_t kind;
+    uint16_t lo;
+    uint16_t hi;
+    struct debug_condition condition;
+    // the condition as typed, for listing
+    char text[64];
+    uint64_t hits;
+};
+
+/*
+breakpoints and watchpoints. the interpreter itself knows nothing about
+them: while any are set the host runs instructions through debug_run
+instead of cpu_emulate_cycle. debug_run looks each instruction up in
+bitmaps of the watched addresses before running it, so a session without
+points pays nothing and one with points pays a few bit tests per
+instruction.
+
+watchpoints see the memory accesses of FX33, FX55, FX65 and DXYN, plus
+5XY2, 5XY3 and F002 in XO-CHIP mode, which are the only instructions
+touching RAM besides fetching.
+*/
+struct debugger {
+    struct debug_point points[DEBUG_MAX_POINTS];
+    uint32_t count;
+
+    // one bit per address with a point of the given kind on it
+    uint64_t break_map[MEMORY_MAX_SIZE / 64];
+    uint64_t read_map[MEMORY_MAX_SIZE / 64];
+    uint64_t write_map[MEMORY_MAX_SIZE / 64];
+    bool active;
+
+    // the point that stopped the last debug_run, or -1
+    int32_t stopped;
+    // the next instruction runs without checks, to get past a stop. clear
+    // it when moving pc elsewhere.
+    bool resume;
+};
+
+void debug_init(struct debugger* debugger);
+
+// returns the id of the new point, or -1 when they are used up
+int32_t debug_add(struct debugger* debugger, const struct debug_point* point);
+bool debug_delete(struct debugger* debugger, int32_t id);
+
+// parses e.g. "V3 == 5 && [0x300] > VA", operands are V0-VF, I, PC, DT,
+// ST, [ADDR] for a RAM byte and numbers
+bool debug_parse_condition(const char* text,
+                           struct debug_condition* condition);
+bool debug_check(const struct debug_condition* condition,
+                 const struct cpu* cpu);
+
+// runs up to cycles instructions and returns how many ran. stops early
+// before an instruction hitting a point, see debugger->stopped.
+uint32_t debug_run(struct debugger* debugger, struct cpu* cpu,
+                   uint32_t cycles);
+
+void debug_print_point(const struct debugger* debugger, int32_t id,
+                       FILE* out);
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "display.h"
+#include "runs.h"
+
+// frames are display images, see display.h
+#define DELTA_FRAME_BYTES DISPLAY_IMAGE_BYTES
+#define DELTA_MAX_BYTES RUNS_MAX_BYTES(DELTA_FRAME_BYTES)
+
+/*
+frame deltas for streaming displays. the image of next is XORed with that
+of prev, which leaves zeros everywhere a sprite didn't touch or a lores
+screen doesn't reach, and the result is packed as zero runs, see runs.h. a
+keyframe is a delta against a blank display, pass NULL as prev.
+
+out must hold DELTA_MAX_BYTES, returns the bytes written
+*/
+size_t delta_encode(const struct display* prev, const struct display* next,
+                    uint8_t* out);
+
+// XORs a delta into display, false if it is malformed
+bool delta_apply(struct display* display, const uint8_t* in, size_t size);
@@ -0,0 +1,6 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// writes the mnemonic of opcode into out, e.g. "add V1, V2"
+void disasm_opcode(uint16_t opcode, char* out, size_t size);
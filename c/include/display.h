@@ -0,0 +1,77 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// CHIP-8 resolution, SUPER-CHIP and XO-CHIP hires mode doubles it
+#define SCREEN_WIDTH 64
+#define SCREEN_HEIGHT 32
+#define DISPLAY_MAX_WIDTH 128
+#define DISPLAY_MAX_HEIGHT 64
+// XO-CHIP draws to two bitplanes, a pixel's color is its bit in each
+#define DISPLAY_PLANES 2
+#define DISPLAY_COLORS (1U << DISPLAY_PLANES)
+
+// ASCII art for the colors of display_pixel
+#define DISPLAY_ASCII ".#o@"
+
+__extension__ typedef unsigned __int128 display_row;
+
+/*
+the display is bit-packed, one 128 bit row per line and plane with the
+leftmost pixel in the most significant bit. lores displays only use the top
+64 bits of the first 32 rows, so a CHIP-8 row is rows[0][y] >> 64.
+
+a row fits a register pair, so clearing, scrolling and XORing a 16 wide
+sprite into a row with its collision test are a few shifts and logical ops
+each, with no per pixel work anywhere.
+*/
+struct display {
+    display_row rows[DISPLAY_PLANES][DISPLAY_MAX_HEIGHT];
+    // SCREEN_WIDTH x SCREEN_HEIGHT or DISPLAY_MAX_WIDTH x DISPLAY_MAX_HEIGHT
+    uint32_t width;
+    uint32_t height;
+    // keeps the struct free of padding, so displays compare with memcmp
+    uint64_t reserved;
+};
+
+// blank lores and hires displays
+extern const struct display display_blank[2];
+
+// 0xRRGGBB of every color, plane 0 alone is white on black
+extern const uint32_t display_palette[DISPLAY_COLORS];
+
+// color of the pixel at x, y in the display's own resolution
+static inline uint8_t display_pixel(const struct display* display,
+                                    uint32_t x, uint32_t y) {
+    const uint32_t shift = DISPLAY_MAX_WIDTH - 1 - x;
+    return (uint8_t)((display->rows[0][y] >> shift) & 1U) |
+           (uint8_t)(((display->rows[1][y] >> shift) & 1U) << 1U);
+}
+
+// color at x, y of a DISPLAY_MAX_WIDTH x DISPLAY_MAX_HEIGHT canvas, which
+// shows lores pixels as 2x2 blocks
+static inline uint8_t display_canvas_pixel(const struct display* display,
+                                           uint32_t x, uint32_t y) {
+    const uint32_t scale = DISPLAY_MAX_WIDTH / display->width;
+    return display_pixel(display, x / scale, y / scale);
+}
+
+// blanks the display and sets its resolution
+void display_reset(struct display* display, bool hires);
+
+/*
+a display as bytes: width and height, then the rows of plane 0 and plane 1
+in order, each most significant byte first. a CHIP-8 screen is the first 8
+bytes of rows 0 to 31 of plane 0 and zeros everywhere else.
+*/
+#define DISPLAY_ROW_BYTES (DISPLAY_MAX_WIDTH / 8)
+#define DISPLAY_IMAGE_BYTES \
+    (2 + DISPLAY_PLANES * DISPLAY_MAX_HEIGHT * DISPLAY_ROW_BYTES)
+
+void display_put_row(uint8_t* out, display_row row);
+display_row display_get_row(const uint8_t* in);
+
+void display_to_image(const struct display* display, uint8_t* image);
+// false if the image holds a resolution the display doesn't have
+bool display_from_image(struct display* display, const uint8_t* image);
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+// input index meaning "no key held" for a frame
+#define EXPLORE_NO_KEY 16
+#define EXPLORE_ALL_INPUTS 0x1FFFFU
+
+typedef bool (*explore_predicate)(const struct cpu* cpu, void* user);
+typedef int32_t (*explore_score)(const struct cpu* cpu, void* user);
+
+/*
+searches the space of keypad inputs starting from root. every node is a
+frame: the parent is forked once per input in config.inputs, the input is
+held for cycles_per_frame instructions and the timers tick once. states are
+deduplicated by cpu_state_hash.
+
+nodes are popped in batches from a shared frontier, a FIFO for breadth
+first or a max-heap on score for best first, and expanded by worker
+threads into their own pools. instances migrate between the worker pools,
+which is fine because they are all torn down together at the end.
+*/
+struct explore_config {
+    uint32_t threads;
+    uint32_t cycles_per_frame;
+    uint32_t max_depth;
+    // capacity of the visited set, the search stops once it is full
+    uint32_t max_states;
+    // bit n branches on key n, bit EXPLORE_NO_KEY on releasing all keys
+    uint32_t inputs;
+
+    explore_predicate goal;
+    // if set, search best first on the highest score
+    explore_score score;
+    void* user;
+};
+
+struct explore_result {
+    bool found;
+    // input per frame leading from root to the goal, free() it when done
+    uint8_t* inputs;
+    uint32_t depth;
+
+    uint64_t frames;
+    uint64_t states;
+    double seconds;
+};
+
+int32_t explore_run(struct cpu* root, const struct explore_config* config,
+                    struct explore_result* result);
@@ -0,0 +1,83 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+#define EXPORT_MAGIC 0x58453843U // "C8EX"
+#define EXPORT_VERSION 2
+#define EXPORT_MAX_SLOTS 65536U
+
+/*
+live state of running instances in a POSIX shared memory segment, for bots
+and dashboards in other local processes. the segment is a header followed by
+one slot per instance:
+
+    struct export_header
+    struct export_slot slots[header.slots]
+
+every slot is guarded by a seqlock. the emulator makes seq odd, copies its
+state in and makes seq even again, and never waits for anyone. readers copy
+the state out and retry if seq was odd or changed in the meantime.
+
+input goes the other way: a reader stores a key mask into input, which the
+emulator merges with its own keys once per frame. only keys whose remote
+state changed are touched, so a local keyboard keeps working too.
+*/
+struct export_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t slots;
+    uint32_t slot_size;
+} __attribute__((aligned(64)));
+
+// copied out of struct cpu, display as in display.h
+struct export_state {
+    uint64_t frame;
+    struct display display;
+    uint8_t v[16];
+    uint16_t stack[16];
+    uint16_t i;
+    uint16_t pc;
+    uint16_t key;
+    uint8_t sp;
+    uint8_t dt;
+    uint8_t st;
+    // enum cpu_mode
+    uint8_t mode;
+};
+
+struct export_slot {
+    uint32_t seq __attribute__((aligned(64)));
+    struct export_state state;
+
+    // written by readers, bit 16 is set once someone drives the keys
+    uint32_t input __attribute__((aligned(64)));
+} __attribute__((aligned(64)));
+
+#define EXPORT_INPUT_ACTIVE (1U << 16U)
+
+struct export;
+
+// creates or replaces the segment /name with count empty slots
+struct export* export_create(const char* name, uint32_t count);
+
+// maps an existing segment, for readers
+struct export* export_open(const char* name);
+
+// unmaps the segment and removes it if this side created it
+void export_destroy(struct export* export);
+
+uint32_t export_slots(const struct export* export);
+
+// emulator side, on an export from export_create. call once per frame.
+void export_publish(struct export* export, uint32_t slot,
+                    const struct cpu* cpu, uint64_t frame);
+void export_poll_input(struct export* export, uint32_t slot,
+                       struct cpu* cpu);
+
+// reader side, a consistent copy of the last published frame
+bool export_read(const struct export* export, uint32_t slot,
+                 struct export_state* out);
+void export_send_input(struct export* export, uint32_t slot, uint16_t keys);
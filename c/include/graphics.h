@@ -2,17 +2,18 @@
 #include <SDL2/SDL_render.h>
 #include <stdbool.h>
 
-#define SCREEN_WIDTH 64
-#define SCREEN_HEIGHT 32
+#include "display.h"
 
 struct graphics {
-    uint32_t vram[64 * 32];
     SDL_Window* window;
     SDL_Renderer* renderer;
-    bool draw_flag;
-} __attribute__((aligned(128)));
+    // the hires canvas, lores frames fill it at 2x
+    SDL_Texture* texture;
+};
 
 struct graphics* graphics_create(void);
 int32_t graphics_init(struct graphics* graphics);
-void graphics_draw(struct graphics* graphics);
+// renders into the back buffer, graphics_present shows it
+void graphics_draw(struct graphics* graphics, const struct display* display);
+void graphics_present(struct graphics* graphics);
 void graphics_destroy(struct graphics* graphics);
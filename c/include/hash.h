@@ -0,0 +1,31 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// 64bit finalizer from murmur3
+static inline uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33U;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33U;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33U;
+    return h;
+}
+
+// word at a time hash, fast enough to rehash a page on every frame
+static inline uint64_t hash_bytes(const void* data, size_t len, uint64_t seed) {
+    const uint8_t* bytes = data;
+    uint64_t h = seed ^ (len * 0x9E3779B97F4A7C15ULL);
+
+    for (; len >= 8; len -= 8, bytes += 8) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        h = (h ^ word) * 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 31U;
+    }
+    for (; len > 0; len--, bytes++) {
+        h = (h ^ *bytes) * 0x100000001B3ULL;
+    }
+    return hash_mix(h);
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <SDL2/SDL_events.h>
+
+#include "cpu.h"
+#include "latency.h"
+
+// latency may be NULL
+void cpu_handle_sdl_key_event(struct cpu* cpu, SDL_Event event,
+                              struct latency* latency);
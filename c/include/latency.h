@@ -0,0 +1,83 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+// linear buckets per power of two, bounding the error of a value to 1/16
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+// key events followed at once, more are counted as dropped
+#define LATENCY_MAX_PENDING 32
+// key events nothing came of within this long are given up on
+#define LATENCY_TIMEOUT_NS 1000000000ULL
+
+/*
+log-linear histogram of nanoseconds in the style of HdrHistogram. values
+below 16 get a bucket each, above that every power of two is split into 16
+buckets, so recording is a couple of shifts and percentiles stay within
+about 6% anywhere from nanoseconds to hours.
+*/
+struct histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_record(struct histogram* histogram, uint64_t value);
+
+// lower bound of the bucket holding the given percentile, 0 when empty
+uint64_t histogram_percentile(const struct histogram* histogram,
+                              double percentile);
+
+enum latency_metric {
+    // from a key event to the first instruction reading that key
+    LATENCY_KEY_OBSERVE,
+    // ... to the first draw to the display after that
+    LATENCY_KEY_CHANGE,
+    // ... to the present showing that change
+    LATENCY_KEY_PRESENT,
+    // per frame time spent emulating, drawing and presenting
+    LATENCY_FRAME_EMULATE,
+    LATENCY_FRAME_RENDER,
+    LATENCY_FRAME_PRESENT,
+    LATENCY_METRICS,
+};
+
+/*
+input to photon latency for one instance. every key event is followed
+through three stages: an instruction reading the key (SKP, SKNP or FX0A,
+see cpu->key_read), the next draw to the display (see cpu->display_writes)
+and the present that shows it. events nothing comes of, e.g. keys the game ignores, time out.
+
+if a stats file is given it is rewritten once a second, so it can be
+watched while the emulator runs. all histograms are printed on destroy.
+*/
+struct latency;
+
+struct latency* latency_create(const char* stats_filename);
+void latency_destroy(struct latency* latency);
+
+// monotonic nanoseconds, the clock every stage is measured on
+uint64_t latency_now(void);
+
+void latency_key(struct latency* latency, uint8_t key, bool pressed);
+
+// call after every instruction, cheap while no event waits on the guest
+void latency_cycle(struct latency* latency, struct cpu* cpu);
+
+// call right after presenting the display
+void latency_present(struct latency* latency);
+
+void latency_record(struct latency* latency, enum latency_metric metric,
+                    uint64_t ns);
+
+// call once per emulated frame, times out stale events and refreshes the
+// stats file
+void latency_frame(struct latency* latency);
+
+void latency_print(const struct latency* latency, FILE* file);
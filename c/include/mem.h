@@ -0,0 +1,64 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+guest memory is split into 16 pages of 256 bytes. an instance only holds
+pointers to them:
+    - the font page and the zero page are static and shared by everyone
+    - ROM pages point straight into a loaded struct rom and are shared by
+      every instance running that ROM
+    - pages the guest has written to are private copies taken from the
+      instance pool (copy on write)
+
+XO-CHIP has 64 KB of memory, split into the same 16 pages of 4 KB each, see
+cpu_set_mode.
+*/
+#define MEMORY_SIZE 4096
+#define MEMORY_MASK (MEMORY_SIZE - 1)
+#define PAGE_SHIFT 8
+#define PAGE_SIZE (1U << PAGE_SHIFT)
+#define PAGE_MASK (PAGE_SIZE - 1)
+#define PAGE_COUNT (MEMORY_SIZE >> PAGE_SHIFT)
+#define APP_MEMORY_OFFSET 0x200
+
+#define MEMORY_MAX_SIZE 65536
+#define MEMORY_MAX_MASK (MEMORY_MAX_SIZE - 1)
+#define PAGE_MAX_SHIFT 12
+#define PAGE_MAX_SIZE (1U << PAGE_MAX_SHIFT)
+
+_Static_assert(MEMORY_MAX_SIZE >> PAGE_MAX_SHIFT == PAGE_COUNT,
+               "64 KB of memory takes as many pages as 4 KB");
+
+// a pooled page, refcounted so it can later be shared between instances.
+// data comes first so a page pointer and its data pointer are the same.
+struct page {
+    uint8_t data[PAGE_SIZE];
+    uint32_t refs;
+};
+
+// the same for 64 KB instances
+struct large_page {
+    uint8_t data[PAGE_MAX_SIZE];
+    uint32_t refs;
+};
+
+// the 4x5 font at 0x000, and for SUPER-CHIP and XO-CHIP the same plus the
+// 8x10 font at FONT_BIG_OFFSET. both are zero padded to a large page like
+// the zero page, so any mode can map them.
+extern const uint8_t mem_font_page[PAGE_MAX_SIZE];
+extern const uint8_t mem_super_font_page[PAGE_MAX_SIZE];
+extern const uint8_t mem_zero_page[PAGE_MAX_SIZE];
+
+#define FONT_BIG_OFFSET 0x050
+
+struct cpu;
+
+void mem_init(struct cpu* cpu);
+void mem_map(struct cpu* cpu, uint32_t page, const uint8_t* data);
+bool mem_unshare(struct cpu* cpu, uint32_t page);
+void mem_share(struct cpu* cpu, uint32_t page, struct cpu* other);
+// takes another reference on a pooled page, for cpu_fork
+void mem_retain(struct cpu* cpu, uint32_t page);
+void mem_hash(struct cpu* cpu);
+void mem_release(struct cpu* cpu);
@@ -0,0 +1,81 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rom.h"
+
+#define PACK_MAGIC 0x4B503843U // "C8PK"
+#define PACK_VERSION 1
+
+// quirk profiles a ROM was written for, numbered like enum cpu_mode so
+// frontends can pass them to cpu_set_mode
+#define PACK_PROFILE_CHIP8 0
+#define PACK_PROFILE_SCHIP 1
+#define PACK_PROFILE_XOCHIP 2
+
+/*
+many ROMs in one file, meant to be mmap'd rather than read. the file is
+
+    struct pack_header
+    struct pack_entry entries[count]
+    uint32_t index[slots]
+    names, NUL terminated
+    ROM data, every ROM page aligned and zero padded to a whole page
+
+the index is an open addressed hash table on hash_bytes of the name with
+linear probing, holding entry number + 1 (0 is an empty slot). since ROM
+data is padded like a struct rom, instances map the pages of a packed ROM
+straight out of the mapping instead of copying them.
+*/
+struct pack_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t count;
+    // a power of two, at least twice count
+    uint32_t slots;
+    uint64_t entries;
+    uint64_t index;
+    uint64_t names;
+    // of the whole file, to catch truncated packs
+    uint64_t size;
+};
+
+struct pack_entry {
+    uint64_t key;
+    // of the ROM data, a multiple of PAGE_SIZE
+    uint64_t offset;
+    uint32_t size;
+    // offset of the name from header.names
+    uint32_t name;
+    // instructions per 60Hz frame, 0 if unknown
+    uint16_t ipf;
+    uint8_t profile;
+    uint8_t reserved[5];
+};
+
+_Static_assert(sizeof(struct pack_header) == 48, "pack header is 48 bytes");
+_Static_assert(sizeof(struct pack_entry) == 32, "pack entries are 32 bytes");
+
+struct pack;
+
+// a packed ROM. rom.data points into the mapping and stays valid until
+// the pack is closed, so it must outlive every instance running it.
+struct pack_rom {
+    struct rom rom;
+    const char* name;
+    uint16_t ipf;
+    uint8_t profile;
+};
+
+// maps the file and checks the header, nothing else is read up front
+struct pack* pack_open(const char* filename);
+void pack_close(struct pack* pack);
+
+uint32_t pack_count(const struct pack* pack);
+uint64_t pack_key(const char* name);
+
+// looks a ROM up by name, e.g. "pong.ch8"
+bool pack_find(const struct pack* pack, const char* name,
+               struct pack_rom* out);
+bool pack_get(const struct pack* pack, uint32_t index, struct pack_rom* out);
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-size block allocator. Blocks are carved out of large chunks and
+// recycled through an intrusive free list, so handing out an instance or a
+// guest page costs a couple of pointer moves instead of a malloc.
+// A pool is not thread-safe; every thread that allocates needs its own.
+struct pool {
+    size_t block_size;
+    size_t align;
+    size_t blocks_per_chunk;
+    void* free_list;
+    void* chunks;
+    size_t allocated;
+};
+
+int32_t pool_init(struct pool* pool, size_t block_size, size_t align,
+                  size_t blocks_per_chunk);
+void* pool_alloc(struct pool* pool);
+void pool_free(struct pool* pool, void* block);
+void pool_destroy(struct pool* pool);
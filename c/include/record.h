@@ -0,0 +1,43 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "display.h"
+
+// frames queued between the emulator and the encoder, a power of two
+#define RECORD_QUEUE_FRAMES 256U
+#define RECORD_FPS 60
+
+// a presented frame and whether the tone was on during it
+struct record_frame {
+    struct display display;
+    bool sound;
+};
+
+/*
+gameplay recorder. record_frame only copies the frame into a single
+producer, single consumer queue, a background thread does the encoding. if
+the encoder falls a whole queue behind, frames are dropped rather than
+stalling the emulator, and the count is reported when the recording ends.
+headless runs going flat out can ask to wait for the encoder instead.
+
+the file is a header followed by one tagged frame at a time: a frame equal
+to the previous one is a single tag byte, anything else also carries its
+delta (see delta.h). see chip8-video for exporting to Y4M, WAV and GIF.
+*/
+struct record;
+
+struct record* record_create(const char* filename, bool wait);
+
+// call once per presented frame from the emulating thread
+void record_frame(struct record* record, const struct display* display,
+                  bool sound);
+
+// encodes whatever is left and closes the file
+void record_destroy(struct record* record);
+
+struct record_reader;
+
+struct record_reader* record_open(const char* filename);
+bool record_next(struct record_reader* reader, struct record_frame* frame);
+void record_close(struct record_reader* reader);
@@ -0,0 +1,14 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// a ROM image loaded once and shared read-only by every instance running it.
+// data is zero padded to a whole number of pages so instances can map it
+// page by page without copying.
+struct rom {
+    uint8_t* data;
+    size_t size;
+};
+
+struct rom* rom_load(const char* filename);
+void rom_destroy(struct rom* rom);
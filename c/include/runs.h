@@ -0,0 +1,57 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+zero run packing for trace files and display deltas. a control byte
+c < 0x80 is followed by c + 1 literal bytes, c >= 0x80 stands for c - 0x7F
+zero bytes. zeros only bump a pending count until the next literal byte, so
+long stretches of them cost next to nothing to pack.
+*/
+
+// worst case alternates single literal and zero bytes, 3 bytes for every 2
+#define RUNS_MAX_BYTES(len) (((len) + 1) / 2 * 3)
+
+struct runs {
+    uint8_t* out;
+    size_t size;
+    size_t zeros;
+    // control byte of the open literal run, 0 bytes long if none is open
+    size_t literal;
+    uint32_t literal_len;
+};
+
+// writes out the pending zeros, call once the last byte is in
+void runs_flush_zeros(struct runs* runs);
+
+static inline void runs_zeros(struct runs* runs, size_t count) {
+    runs->zeros += count;
+    runs->literal_len = 0;
+}
+
+static inline void runs_byte(struct runs* runs, uint8_t byte) {
+    if (!byte) {
+        runs_zeros(runs, 1);
+        return;
+    }
+    if (runs->zeros) {
+        runs_flush_zeros(runs);
+    }
+    if (runs->literal_len == 0 || runs->literal_len == 128) {
+        runs->literal = runs->size++;
+        runs->literal_len = 0;
+    }
+    runs->out[runs->size++] = byte;
+    runs->out[runs->literal] = (uint8_t)runs->literal_len++;
+}
+
+static inline void runs_bytes(struct runs* runs, const uint8_t* bytes,
+                              size_t count) {
+    for (size_t n = 0; n < count; ++n) {
+        runs_byte(runs, bytes[n]);
+    }
+}
+
+// unpacks up to len bytes into out. returns how many, or SIZE_MAX if in is
+// malformed or holds more than len.
+size_t runs_unpack(const uint8_t* in, size_t size, uint8_t* out, size_t len);
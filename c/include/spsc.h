@@ -0,0 +1,61 @@
+#pragma once
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+positions of a single producer, single consumer queue, shared by traces and
+recordings. head and tail only ever grow and live on separate cache lines
+so the two sides don't share a line on every entry. the slots belong to the
+user, entry n goes in slot n & (size - 1) of a power of two sized array.
+*/
+struct spsc {
+    uint64_t head __attribute__((aligned(64)));
+    uint64_t tail __attribute__((aligned(64)));
+};
+
+// producer side, entries queued and not yet drained
+static inline uint64_t spsc_used(const struct spsc* queue) {
+    return queue->head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+}
+
+// publishes the entry written to slot head
+static inline void spsc_push(struct spsc* queue) {
+    __atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
+}
+
+// consumer side, entries up to head may be read
+static inline uint64_t spsc_head(const struct spsc* queue) {
+    return __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+}
+
+// hands the slots before tail back to the producer
+static inline void spsc_release(struct spsc* queue, uint64_t tail) {
+    __atomic_store_n(&queue->tail, tail, __ATOMIC_RELEASE);
+}
+
+/*
+background thread that calls drain until it is stopped. when drain finds
+nothing to do the thread sleeps until it is kicked, or for 10 ms so that
+producers only need to kick it every so often. drain runs once more after
+drainer_stop, so everything queued before it is handled.
+*/
+struct drainer {
+    bool (*drain)(void* context);
+    void* context;
+    bool stop;
+    pthread_t thread;
+    sem_t wake;
+};
+
+int32_t drainer_start(struct drainer* drainer, bool (*drain)(void* context),
+                      void* context);
+
+void drainer_kick(struct drainer* drainer);
+
+// kicks the thread and yields until queue has room for another entry
+void drainer_wait(struct drainer* drainer, const struct spsc* queue,
+                  uint64_t size);
+
+void drainer_stop(struct drainer* drainer);
@@ -0,0 +1,55 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "delta.h"
+
+#define STREAM_ALL UINT32_MAX
+#define STREAM_MAX_CLIENTS 64
+// updates of an instance between keyframes
+#define STREAM_KEYFRAME_INTERVAL 300U
+// unsent bytes a client may fall behind by before it skips deltas
+#define STREAM_CLIENT_BUFFER 65536U
+
+#define STREAM_KEYFRAME 0
+#define STREAM_DELTA 1
+
+/*
+display streaming over a Unix domain socket. a client connects and writes
+the uint32_t ids of the instances it wants, or STREAM_ALL, in host byte
+order. for every one it first gets a keyframe of the current display, then
+a delta whenever the instance draws (see delta.h) and a keyframe every
+STREAM_KEYFRAME_INTERVAL updates.
+
+every message is a struct stream_message followed by size bytes of delta.
+a client that stops reading skips deltas while its buffer is full and
+resyncs with a keyframe once it has room again, so a slow relay never
+stalls the emulator.
+*/
+struct stream_message {
+    uint32_t instance;
+    uint32_t frame;
+    uint16_t size;
+    uint8_t type;
+    uint8_t reserved;
+};
+
+_Static_assert(sizeof(struct stream_message) == 12,
+               "stream messages are 12 bytes");
+
+struct stream;
+
+// listens on path, replacing any stale socket there
+struct stream* stream_create(const char* path, uint32_t instances);
+void stream_destroy(struct stream* stream);
+
+// accepts clients, reads subscriptions and flushes pending output. waits
+// up to timeout_ms for something to happen, so a host can sleep in here
+// until its next frame.
+void stream_poll(struct stream* stream, int32_t timeout_ms);
+
+// call when an instance has drawn, i.e. cpu->draw_flag is set
+void stream_publish(struct stream* stream, uint32_t instance,
+                    const struct display* display, uint32_t frame);
+
+uint32_t stream_clients(const struct stream* stream);
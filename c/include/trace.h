@@ -0,0 +1,79 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "spsc.h"
+
+// records per ring, must be a power of two
+#define TRACE_RING_SIZE 65536U
+#define TRACE_MAX_RINGS 64
+
+// one executed instruction. reg is X of the opcode and value is VX after
+// it ran, which covers every instruction that writes a single register.
+struct trace_record {
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t i;
+    uint8_t reg;
+    uint8_t value;
+};
+
+_Static_assert(sizeof(struct trace_record) == 8, "trace records are 8 bytes");
+
+// the emulating thread appends, the trace writer thread drains, see spsc.h
+struct trace;
+
+struct trace_ring {
+    struct spsc queue;
+    uint32_t id;
+    struct trace* trace;
+    struct trace_record records[TRACE_RING_SIZE]
+        __attribute__((aligned(64)));
+};
+
+/*
+recorder owning one ring per traced instance and a background thread that
+drains them into a file. the file is a header followed by blocks of records
+from one ring each. compressed blocks store every record XORed with the
+previous record of its ring, packed as runs of zero and literal bytes.
+consecutive records mostly differ in the low pc byte, so this typically
+brings a record down to two or three bytes.
+*/
+struct trace* trace_create(const char* filename, bool compress);
+
+// returns a fresh ring to hook up to an instance via cpu->trace. an
+// instance must only be run by one thread at a time while traced.
+struct trace_ring* trace_attach(struct trace* trace);
+
+// drains whatever is left, stops the writer and closes the file
+void trace_destroy(struct trace* trace);
+
+// wakes the writer, called every quarter ring
+void trace_kick(struct trace_ring* ring);
+
+void trace_wait(struct trace_ring* ring);
+
+static inline void trace_append(struct trace_ring* ring,
+                                struct trace_record record) {
+    const uint64_t head = ring->queue.head;
+    if (spsc_used(&ring->queue) == TRACE_RING_SIZE) {
+        // the writer fell behind, block rather than lose records
+        trace_wait(ring);
+    }
+    ring->records[head & (TRACE_RING_SIZE - 1)] = record;
+    spsc_push(&ring->queue);
+    if (((head + 1) & (TRACE_RING_SIZE / 4 - 1)) == 0) {
+        trace_kick(ring);
+    }
+}
+
+// reading traces back, see tools/trace.c
+struct trace_reader;
+
+struct trace_reader* trace_open(const char* filename);
+
+// returns false at the end of the file or on a corrupt block
+bool trace_next(struct trace_reader* reader, uint32_t* ring,
+                struct trace_record* record);
+
+void trace_close(struct trace_reader* reader);
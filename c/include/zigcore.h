@@ -0,0 +1,31 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// C ABI of the Zig core, see zig/src/ffi.zig. `zig build` in ../zig leaves
+// it in zig-out/lib/libchip8zig.a.
+
+struct zig_core;
+
+// mirrors ffi.State
+struct zig_state {
+    uint8_t v[16];
+    uint16_t stack[16];
+    uint16_t i;
+    uint16_t pc;
+    uint16_t sp;
+    uint8_t dt;
+    uint8_t st;
+};
+
+struct zig_core* chip8_zig_create(uint64_t seed);
+void chip8_zig_destroy(struct zig_core* core);
+bool chip8_zig_load(struct zig_core* core, const uint8_t* rom, size_t len);
+void chip8_zig_step(struct zig_core* core);
+void chip8_zig_tick(struct zig_core* core);
+void chip8_zig_state(const struct zig_core* core, struct zig_state* out);
+const uint8_t* chip8_zig_mem(const struct zig_core* core);
+uint64_t chip8_zig_row(const struct zig_core* core, uint32_t y);
+void chip8_zig_set_v(struct zig_core* core, uint8_t x, uint8_t value);
+void chip8_zig_set_key(struct zig_core* core, uint8_t key, bool pressed);
@@ -1,6 +1,10 @@
 #include "audio.h"
 #include <math.h>
 
+// samples are generated on the stack in chunks of this size, so instances
+// don't carry a buffer of their own
+#define AUDIO_CHUNK_SAMPLES 512
+
 struct audio* audio_create(void) {
     struct audio* audio = malloc(sizeof(struct audio));
     if (!audio) {
@@ -39,7 +43,6 @@ int32_t audio_init(struct audio* audio) {
 
     SDL_PauseAudioDevice(device, 0);
     *audio = (struct audio){
-        .buffer = {0},
         .device = device,
         .wave_position = 0,
         .wave_increment = (audio_tone * (2.0 * M_PI)) / audio_frequency,
@@ -52,13 +55,26 @@ void audio_beep(struct audio* audio, int len) {
                       (audio_samples_per_frame * 2)) {
         return;
     }
-    audio_sine(audio, len);
-    SDL_QueueAudio(audio->device, audio->buffer, len);
+    uint8_t buffer[AUDIO_CHUNK_SAMPLES];
+    while (len > 0) {
+        const int32_t chunk =
+            len < AUDIO_CHUNK_SAMPLES ? len : AUDIO_CHUNK_SAMPLES;
+        audio_sine(audio, buffer, chunk);
+        SDL_QueueAudio(audio->device, buffer, chunk);
+        len -= chunk;
+    }
+}
+
+void audio_stop(struct audio* audio) {
+    if (!audio) {
+        return;
+    }
+    SDL_ClearQueuedAudio(audio->device);
 }
 
-void audio_sine(struct audio* audio, int len) {
+void audio_sine(struct audio* audio, uint8_t* buffer, int len) {
     for (int32_t i = 0; i < len; i++) {
-        audio->buffer[i] = (uint8_t)((
+        buffer[i] = (uint8_t)((
             audio_amplitude * sin(audio->wave_position) + audio_bias));
         audio->wave_position += audio->wave_increment;
     }
@@ -0,0 +1,647 @@
+#include "batch.h"
+#include <string.h>
+#include "instr.h"
+
+// results of vector comparisons, all ones where true
+typedef int8_t batch_s8 __attribute__((vector_size(BATCH_LANES)));
+typedef int16_t batch_s16 __attribute__((vector_size(BATCH_LANES)));
+typedef uint8_t half_u8 __attribute__((vector_size(BATCH_HALF)));
+typedef int8_t half_s8 __attribute__((vector_size(BATCH_HALF)));
+
+// one build runs on any x86-64 and picks the AVX2 code where available
+#if defined(__x86_64__)
+#define BATCH_TARGETS __attribute__((target_clones("avx2", "default")))
+#else
+#define BATCH_TARGETS
+#endif
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// below this many lanes per group on average, grouping costs more than it
+// saves and the lanes run one by one instead
+#define MIN_GROUP_LANES 8
+// steps between checks of the group size
+#define PROBE_STEPS 64
+// most batch_runs a diverging batch stays split, about a second at 60 fps
+#define MAX_REJOIN_WAIT 63
+
+// 16 bit lanes are addressed through the half they live in
+#define LANE16(field, lane) (field)[(lane) / BATCH_HALF][(lane) % BATCH_HALF]
+
+static ALWAYS_INLINE batch_u8 select8(batch_u8 mask, batch_u8 a, batch_u8 b) {
+    return (a & mask) | (b & ~mask);
+}
+
+static ALWAYS_INLINE batch_u16 select16(batch_u16 mask, batch_u16 a,
+                                        batch_u16 b) {
+    return (a & mask) | (b & ~mask);
+}
+
+// lanes of the given half of v, widened to 16 bits
+static ALWAYS_INLINE batch_u16 widen(batch_u8 v, uint32_t half) {
+    half_u8 part;
+    memcpy(&part, (const uint8_t*)&v + half * BATCH_HALF, sizeof(part));
+    return __builtin_convertvector(part, batch_u16);
+}
+
+static ALWAYS_INLINE batch_u16 widen_mask(batch_u8 mask, uint32_t half) {
+    half_s8 part;
+    memcpy(&part, (const uint8_t*)&mask + half * BATCH_HALF, sizeof(part));
+    return (batch_u16)__builtin_convertvector(part, batch_s16);
+}
+
+static ALWAYS_INLINE batch_u8 narrow_mask(batch_s16 low, batch_s16 high) {
+    const half_s8 parts[2] = {
+        __builtin_convertvector(low, half_s8),
+        __builtin_convertvector(high, half_s8),
+    };
+    batch_u8 mask;
+    memcpy(&mask, parts, sizeof(mask));
+    return mask;
+}
+
+// bit n is set for every all ones lane n of mask
+static ALWAYS_INLINE uint32_t lane_bits(batch_u8 mask) {
+    uint64_t words[BATCH_LANES / 8];
+    memcpy(words, &mask, sizeof(words));
+
+    uint32_t bits = 0;
+    for (uint32_t n = 0; n < BATCH_LANES / 8; ++n) {
+        // gathers the top bit of each byte into the top byte
+        const uint64_t gathered =
+            (words[n] & 0x8040201008040201ULL) * 0x0101010101010101ULL;
+        bits |= (uint32_t)(gathered >> 56U) << (n * 8);
+    }
+    return bits;
+}
+
+static ALWAYS_INLINE uint16_t fetch_opcode(const struct cpu* cpu,
+                                           uint16_t pc) {
+    return (uint16_t)(cpu_peek(cpu, pc) << 8U | cpu_peek(cpu, pc + 1));
+}
+
+// the subset of pages holding the same bytes in every lane. lanes that
+// wrote to a page have their own copy, which usually still matches.
+static uint16_t shared_pages(const struct batch* batch, uint16_t pages) {
+    const struct cpu* lead = batch->cpu[__builtin_ctz(batch->active)];
+    uint16_t shared = pages;
+    for (; pages; pages &= pages - 1) {
+        const uint32_t n = __builtin_ctz(pages);
+        for (uint32_t lanes = batch->active; lanes; lanes &= lanes - 1) {
+            const struct cpu* cpu = batch->cpu[__builtin_ctz(lanes)];
+            if (cpu->page[n] != lead->page[n] &&
+                memcmp(cpu->page[n], lead->page[n],
+                       1U << batch->page_shift) != 0) {
+                shared &= ~(1U << n);
+                break;
+            }
+        }
+    }
+    return shared;
+}
+
+// pages FX33, FX55 and XO-CHIP's 5XY2 write to in the given lanes
+static uint16_t written_pages(const struct batch* batch, uint32_t lanes,
+                              uint16_t opcode) {
+    const uint16_t op = opcode & 0xF0FFU;
+    const uint32_t x = (opcode >> 8U) & 0xFU;
+    const uint32_t y = (opcode >> 4U) & 0xFU;
+    uint32_t last;
+    if (op == 0xF033) {
+        last = 2;
+    } else if (op == 0xF055) {
+        last = x;
+    } else if (batch->mode == CPU_XOCHIP && (opcode & 0xF00FU) == 0x5002) {
+        last = x > y ? x - y : y - x;
+    } else {
+        return 0;
+    }
+
+    uint16_t pages = 0;
+    for (; lanes; lanes &= lanes - 1) {
+        const uint16_t i = LANE16(batch->i, __builtin_ctz(lanes));
+        pages |= 1U << (i >> batch->page_shift);
+        pages |= 1U << (((i + last) & batch->memory_mask) >> batch->page_shift);
+    }
+    return pages;
+}
+
+// V registers the scalar path may read or write for opcode, besides VX which
+// traces record. all of them for anything not listed.
+static uint16_t touched_registers(uint16_t opcode) {
+    const uint32_t x = (opcode >> 8U) & 0xFU;
+    const uint32_t y = (opcode >> 4U) & 0xFU;
+    const uint16_t up_to_x = (uint16_t)((2U << x) - 1);
+    switch (opcode >> 12U) {
+    case 0x0:
+    case 0x1:
+    case 0x2:
+        return 0;
+    case 0x5: {
+        // XO-CHIP's 5XY2 and 5XY3 cover VX to VY
+        const uint32_t lo = x < y ? x : y;
+        const uint32_t hi = x < y ? y : x;
+        return (uint16_t)(((2U << hi) - 1) & ~((1U << lo) - 1));
+    }
+    case 0x3:
+    case 0x4:
+    case 0x9:
+    case 0xC:
+    case 0xE:
+        return (uint16_t)(1U << y);
+    case 0xB:
+        return 1U;
+    case 0xD:
+        return (uint16_t)(1U << y | 1U << 0xF);
+    case 0xF:
+        switch (opcode & 0xFFU) {
+        case 0x55:
+        case 0x65:
+        case 0x75:
+        case 0x85:
+            return up_to_x;
+        default:
+            return 0;
+        }
+    default:
+        return 0xFFFFU;
+    }
+}
+
+// FX07, FX15 and FX18 are the only instructions looking at the timers
+static bool touches_timers(uint16_t opcode) {
+    const uint16_t op = opcode & 0xF0FFU;
+    return op == 0xF007 || op == 0xF015 || op == 0xF018;
+}
+
+// copies the lane into its instance. registers outside regs and, unless
+// timers is set, the timers are left stale there.
+static void store_lane(const struct batch* batch, uint32_t lane,
+                       struct cpu* cpu, uint16_t regs, bool timers) {
+    for (; regs; regs &= regs - 1) {
+        const uint32_t n = __builtin_ctz(regs);
+        cpu->v[n] = batch->v[n][lane];
+    }
+    cpu->i = LANE16(batch->i, lane);
+    cpu->pc = LANE16(batch->pc, lane);
+    cpu->cycles = batch->cycles;
+    cpu->clock_rate = batch->clock_rate;
+    if (timers) {
+        cpu->dt_end = batch->timer_ticks + batch->dt[lane];
+        cpu->st_end = batch->timer_ticks + batch->st[lane];
+    }
+}
+
+// timers left as of timer_ticks, which must be current
+static uint8_t timer_left(const struct batch* batch, uint64_t end) {
+    return end > batch->timer_ticks ? (uint8_t)(end - batch->timer_ticks)
+                                    : 0;
+}
+
+static void load_lane(struct batch* batch, uint32_t lane,
+                      const struct cpu* cpu, uint16_t regs, bool timers) {
+    for (; regs; regs &= regs - 1) {
+        const uint32_t n = __builtin_ctz(regs);
+        batch->v[n][lane] = cpu->v[n];
+    }
+    LANE16(batch->i, lane) = cpu->i;
+    LANE16(batch->pc, lane) = cpu->pc;
+    if (timers) {
+        batch->dt[lane] = timer_left(batch, cpu->dt_end);
+        batch->st[lane] = timer_left(batch, cpu->st_end);
+    }
+}
+
+// counts the timers down by the ticks since they were last brought up to
+// date
+static ALWAYS_INLINE void update_timers(struct batch* batch) {
+    const uint64_t ticks = batch->cycles * 60 / batch->clock_rate;
+    if (ticks == batch->timer_ticks) {
+        return;
+    }
+    const uint64_t elapsed = ticks - batch->timer_ticks;
+    const batch_u8 step = (batch_u8){0} + (uint8_t)(elapsed < 0xFF ? elapsed
+                                                                   : 0xFF);
+    batch->dt -= select8((batch_u8)(batch->dt < step), batch->dt, step);
+    batch->st -= select8((batch_u8)(batch->st < step), batch->st, step);
+    batch->timer_ticks = ticks;
+}
+
+static void run_scalar(struct batch* batch, uint32_t lanes, uint16_t opcode) {
+    const uint16_t written = written_pages(batch, lanes, opcode);
+    update_timers(batch);
+
+    // only what the instruction can see goes back and forth
+    const uint16_t regs =
+        touched_registers(opcode) | 1U << ((opcode >> 8U) & 0xFU);
+    const bool timers = touches_timers(opcode);
+
+    batch->scalar_cycles += __builtin_popcount(lanes);
+    for (; lanes; lanes &= lanes - 1) {
+        const uint32_t lane = __builtin_ctz(lanes);
+        struct cpu* cpu = batch->cpu[lane];
+        store_lane(batch, lane, cpu, regs, timers);
+        cpu_emulate_cycle(cpu);
+        load_lane(batch, lane, cpu, regs, timers);
+    }
+
+    if (written) {
+        batch->shared_pages = (batch->shared_pages & ~written) |
+                              shared_pages(batch, written);
+    }
+}
+
+static void load_pressed(struct batch* batch) {
+    batch_u16 keys[2] = {{0}, {0}};
+    for (uint32_t lanes = batch->active; lanes; lanes &= lanes - 1) {
+        const uint32_t lane = __builtin_ctz(lanes);
+        LANE16(keys, lane) = batch->cpu[lane]->key;
+    }
+    for (uint32_t k = 0; k < 16; ++k) {
+        batch->pressed[k] = narrow_mask(((keys[0] >> k) & 1) != 0,
+                                        ((keys[1] >> k) & 1) != 0);
+    }
+    batch->pressed_loaded = true;
+}
+
+static ALWAYS_INLINE void advance(struct batch* batch,
+                                  const batch_u16 mask[2]) {
+    for (uint32_t h = 0; h < 2; ++h) {
+        batch->pc[h] =
+            select16(mask[h], (batch->pc[h] + 2) & batch->memory_mask,
+                     batch->pc[h]);
+    }
+}
+
+static ALWAYS_INLINE void skip_if(struct batch* batch, const batch_u16 mask[2],
+                                  batch_s8 cond) {
+    for (uint32_t h = 0; h < 2; ++h) {
+        const batch_u16 step = 2 + (widen_mask((batch_u8)cond, h) & 2);
+        batch->pc[h] = select16(
+            mask[h], (batch->pc[h] + step) & batch->memory_mask, batch->pc[h]);
+    }
+}
+
+// runs opcode on the lanes in mask, returns false if it needs the scalar path
+static ALWAYS_INLINE bool run_vector(struct batch* batch, batch_u8 mask,
+                                     uint16_t opcode) {
+    const union instr instr = {.instr = opcode};
+    const batch_u16 mask16[2] = {widen_mask(mask, 0), widen_mask(mask, 1)};
+    const uint32_t x = instr.x;
+    const uint32_t y = instr.y;
+    batch_u8* v = batch->v;
+
+    // skips step over F000 NNNN as a whole, see skip_next
+    if (batch->mode == CPU_XOCHIP &&
+        (instr.opcode == 0x3 || instr.opcode == 0x4 || instr.opcode == 0x5 ||
+         instr.opcode == 0x9 || instr.opcode == 0xE)) {
+        return false;
+    }
+
+    switch (instr.opcode) {
+    case 0x1: {
+        const batch_u16 target = (batch_u16){0} + instr.nnn;
+        for (uint32_t h = 0; h < 2; ++h) {
+            batch->pc[h] = select16(mask16[h], target, batch->pc[h]);
+        }
+        return true;
+    }
+    case 0x3:
+        skip_if(batch, mask16, v[x] == instr.nn);
+        return true;
+    case 0x4:
+        skip_if(batch, mask16, v[x] != instr.nn);
+        return true;
+    case 0x5:
+        skip_if(batch, mask16, v[x] == v[y]);
+        return true;
+    case 0x6:
+        v[x] = select8(mask, (batch_u8){0} + instr.nn, v[x]);
+        advance(batch, mask16);
+        return true;
+    case 0x7:
+        v[x] = select8(mask, v[x] + instr.nn, v[x]);
+        advance(batch, mask16);
+        return true;
+    case 0x8: {
+        // same order as the scalar ops, VF is written before VX is read
+        const batch_u8 vy = v[y];
+        switch (instr.n) {
+        case 0x0:
+            v[x] = select8(mask, vy, v[x]);
+            break;
+        case 0x1:
+            v[x] = select8(mask, v[x] | vy, v[x]);
+            break;
+        case 0x2:
+            v[x] = select8(mask, v[x] & vy, v[x]);
+            break;
+        case 0x3:
+            v[x] = select8(mask, v[x] ^ vy, v[x]);
+            break;
+        case 0x4:
+            v[0xF] = select8(mask, (batch_u8)(vy > 0xFF - v[x]) & 1, v[0xF]);
+            v[x] = select8(mask, v[x] + vy, v[x]);
+            break;
+        case 0x5:
+            v[0xF] = select8(mask, (batch_u8)(vy <= v[x]) & 1, v[0xF]);
+            v[x] = select8(mask, v[x] - vy, v[x]);
+            break;
+        case 0x6:
+            v[0xF] = select8(mask, v[x] & 1, v[0xF]);
+            v[x] = select8(mask, v[x] >> 1, v[x]);
+            break;
+        case 0x7:
+            v[0xF] = select8(mask, (batch_u8)(vy >= v[x]) & 1, v[0xF]);
+            v[x] = select8(mask, vy - v[x], v[x]);
+            break;
+        case 0xE:
+            v[0xF] = select8(mask, v[x] >> 7, v[0xF]);
+            v[x] = select8(mask, v[x] << 1, v[x]);
+            break;
+        default:
+            return false;
+        }
+        advance(batch, mask16);
+        return true;
+    }
+    case 0x9:
+        skip_if(batch, mask16, v[x] != v[y]);
+        return true;
+    case 0xA: {
+        const batch_u16 value = (batch_u16){0} + instr.nnn;
+        for (uint32_t h = 0; h < 2; ++h) {
+            batch->i[h] = select16(mask16[h], value, batch->i[h]);
+        }
+        advance(batch, mask16);
+        return true;
+    }
+    case 0xB:
+        if (batch->mode == CPU_SCHIP) {
+            // BXNN jumps by VX
+            return false;
+        }
+        for (uint32_t h = 0; h < 2; ++h) {
+            const batch_u16 target =
+                (widen(v[0], h) + instr.nnn) & batch->memory_mask;
+            batch->pc[h] = select16(mask16[h], target, batch->pc[h]);
+        }
+        return true;
+    case 0xE: {
+        if (instr.nn != 0x9E && instr.nn != 0xA1) {
+            return false;
+        }
+        if (!batch->pressed_loaded) {
+            load_pressed(batch);
+        }
+        const batch_u8 key = v[x] & 0xF;
+        // latency instrumentation sees which keys were tested, see cpu.h
+        for (uint32_t lanes = lane_bits(mask); lanes; lanes &= lanes - 1) {
+            const uint32_t lane = __builtin_ctz(lanes);
+            batch->cpu[lane]->key_read |= 1U << key[lane];
+        }
+        batch_u8 held = {0};
+        for (uint8_t k = 0; k < 16; ++k) {
+            held |= (batch_u8)(key == k) & batch->pressed[k];
+        }
+        skip_if(batch, mask16, (batch_s8)(instr.nn == 0x9E ? held : ~held));
+        return true;
+    }
+    case 0xF:
+        switch (instr.nn) {
+        case 0x07:
+            update_timers(batch);
+            v[x] = select8(mask, batch->dt, v[x]);
+            break;
+        case 0x15:
+            update_timers(batch);
+            batch->dt = select8(mask, v[x], batch->dt);
+            break;
+        case 0x18:
+            update_timers(batch);
+            batch->st = select8(mask, v[x], batch->st);
+            break;
+        case 0x1E:
+            for (uint32_t h = 0; h < 2; ++h) {
+                const batch_u16 i =
+                    (batch->i[h] + widen(v[x], h)) & batch->memory_mask;
+                batch->i[h] = select16(mask16[h], i, batch->i[h]);
+            }
+            break;
+        case 0x65: {
+            // a gather per lane, still far cheaper than a trip through
+            // cpu_emulate_cycle
+            for (uint32_t lanes = lane_bits(mask); lanes;
+                 lanes &= lanes - 1) {
+                const uint32_t lane = __builtin_ctz(lanes);
+                const struct cpu* cpu = batch->cpu[lane];
+                const uint16_t i = LANE16(batch->i, lane);
+                for (uint32_t n = 0; n <= x; ++n) {
+                    v[n][lane] = cpu_peek(cpu, i + n);
+                }
+            }
+            if (batch->mode == CPU_SCHIP) {
+                // SUPER-CHIP leaves I alone
+                break;
+            }
+            for (uint32_t h = 0; h < 2; ++h) {
+                const batch_u16 i = (batch->i[h] + (uint16_t)(x + 1))
+                                    & batch->memory_mask;
+                batch->i[h] = select16(mask16[h], i, batch->i[h]);
+            }
+            break;
+        }
+        case 0x29:
+            for (uint32_t h = 0; h < 2; ++h) {
+                const batch_u16 i = widen(v[x], h) * 5;
+                batch->i[h] = select16(mask16[h], i, batch->i[h]);
+            }
+            break;
+        default:
+            return false;
+        }
+        advance(batch, mask16);
+        return true;
+    }
+    return false;
+}
+
+// returns the number of groups the lanes fell into
+static ALWAYS_INLINE uint32_t step(struct batch* batch) {
+    batch_u8 pending = batch->lanes;
+    uint32_t bits = batch->active;
+    uint32_t groups = 0;
+
+    while (bits) {
+        const uint32_t lead = __builtin_ctz(bits);
+        const uint16_t pc = LANE16(batch->pc, lead);
+        const uint16_t opcode = fetch_opcode(batch->cpu[lead], pc);
+
+        batch_u8 group =
+            narrow_mask(batch->pc[0] == pc, batch->pc[1] == pc) & pending;
+        uint32_t group_bits = lane_bits(group);
+
+        // lanes may have rewritten the code differently
+        const uint8_t shift = batch->page_shift;
+        const uint16_t code =
+            1U << (pc >> shift) |
+            1U << (((pc + 1) & batch->memory_mask) >> shift);
+        if ((batch->shared_pages & code) != code) {
+            for (uint32_t lanes = group_bits & (group_bits - 1); lanes;
+                 lanes &= lanes - 1) {
+                const uint32_t lane = __builtin_ctz(lanes);
+                if (fetch_opcode(batch->cpu[lane], pc) != opcode) {
+                    group[lane] = 0;
+                    group_bits &= ~(1U << lane);
+                }
+            }
+        }
+
+        pending &= ~group;
+        bits &= ~group_bits;
+        groups++;
+
+        if (run_vector(batch, group, opcode)) {
+            batch->vector_cycles += __builtin_popcount(group_bits);
+        } else {
+            run_scalar(batch, group_bits, opcode);
+        }
+    }
+    return groups;
+}
+
+// whether the lanes share few enough PCs to be worth grouping
+static bool converged(const struct batch* batch) {
+    // XO-CHIP's skips, long I loads and 64 KB pages all take the scalar
+    // path, so its lanes always run one by one
+    if (batch->mode == CPU_XOCHIP) {
+        return false;
+    }
+    uint32_t groups = 0;
+    for (uint32_t bits = batch->active; bits; ++groups) {
+        const uint16_t pc = LANE16(batch->pc, __builtin_ctz(bits));
+        bits &= ~lane_bits(
+            narrow_mask(batch->pc[0] == pc, batch->pc[1] == pc));
+    }
+    return (uint32_t)__builtin_popcount(batch->active) >=
+           groups * MIN_GROUP_LANES;
+}
+
+// runs every lane on its own for cycles instructions. the instances hold
+// the registers until the lanes have converged again.
+static void run_split(struct batch* batch, uint32_t cycles) {
+    if (!batch->split) {
+        batch_sync(batch);
+        batch->split = true;
+    }
+    for (uint32_t lanes = batch->active; lanes; lanes &= lanes - 1) {
+        struct cpu* cpu = batch->cpu[__builtin_ctz(lanes)];
+        for (uint32_t n = 0; n < cycles; ++n) {
+            cpu_emulate_cycle(cpu);
+        }
+    }
+    batch->cycles += cycles;
+    batch->scalar_cycles +=
+        (uint64_t)cycles * __builtin_popcount(batch->active);
+}
+
+// takes the registers back from the instances once enough of them share
+// a PC again
+static void rejoin(struct batch* batch) {
+    uint16_t owned = 0;
+    for (uint32_t lanes = batch->active; lanes; lanes &= lanes - 1) {
+        const uint32_t lane = __builtin_ctz(lanes);
+        LANE16(batch->pc, lane) = batch->cpu[lane]->pc;
+    }
+    if (!converged(batch)) {
+        return;
+    }
+    for (uint32_t lanes = batch->active; lanes; lanes &= lanes - 1) {
+        const uint32_t lane = __builtin_ctz(lanes);
+        // the timers stay as of timer_ticks, see load_lane
+        load_lane(batch, lane, batch->cpu[lane], 0xFFFFU, true);
+        owned |= batch->cpu[lane]->page_owned;
+    }
+    batch->split = false;
+    // only pages a lane owns can have been written
+    if (owned) {
+        batch->shared_pages = (batch->shared_pages & ~owned) |
+                              shared_pages(batch, owned);
+    }
+}
+
+int32_t batch_init(struct batch* batch, struct cpu** cpus, uint32_t count) {
+    if (!batch || count == 0 || count > BATCH_LANES) {
+        return 1;
+    }
+    for (uint32_t n = 1; n < count; ++n) {
+        if (cpus[n]->mode != cpus[0]->mode) {
+            return 1;
+        }
+    }
+
+    *batch = (struct batch){
+        .active = count == BATCH_LANES ? 0xFFFFFFFFU : (1U << count) - 1,
+        .cycles = cpus[0]->cycles,
+        .timer_ticks = cpu_ticks(cpus[0]),
+        .clock_rate = cpus[0]->clock_rate,
+        .memory_mask = cpus[0]->memory_mask,
+        .page_shift = cpus[0]->page_shift,
+        .mode = cpus[0]->mode,
+    };
+    for (uint32_t n = 0; n < count; ++n) {
+        batch->cpu[n] = cpus[n];
+        batch->lanes[n] = 0xFF;
+        load_lane(batch, n, cpus[n], 0xFFFFU, true);
+        // lanes on a different clock keep their timers but take ours
+        batch->dt[n] = cpu_dt(cpus[n]);
+        batch->st[n] = cpu_st(cpus[n]);
+    }
+    batch->shared_pages = shared_pages(batch, 0xFFFF);
+    return 0;
+}
+
+BATCH_TARGETS void batch_run(struct batch* batch, uint32_t cycles) {
+    batch->pressed_loaded = false;
+    if (batch->split) {
+        if (batch->rejoin_wait) {
+            batch->rejoin_wait--;
+        } else {
+            rejoin(batch);
+        }
+    }
+    if (batch->split || !converged(batch)) {
+        run_split(batch, cycles);
+        return;
+    }
+    const uint32_t lanes = __builtin_popcount(batch->active);
+    for (uint32_t n = 0; n < cycles;) {
+        const uint32_t steps =
+            cycles - n < PROBE_STEPS ? cycles - n : PROBE_STEPS;
+        uint32_t groups = 0;
+        for (uint32_t k = 0; k < steps; ++k) {
+            groups += step(batch);
+            batch->cycles++;
+        }
+        n += steps;
+        if (lanes * steps < groups * MIN_GROUP_LANES) {
+            if (batch->rejoin_after < MAX_REJOIN_WAIT) {
+                batch->rejoin_after = batch->rejoin_after * 2 + 1;
+            }
+            batch->rejoin_wait = batch->rejoin_after;
+            run_split(batch, cycles - n);
+            return;
+        }
+    }
+    batch->rejoin_after = 0;
+}
+
+void batch_sync(struct batch* batch) {
+    if (batch->split) {
+        return;
+    }
+    for (uint32_t lanes = batch->active; lanes; lanes &= lanes - 1) {
+        const uint32_t lane = __builtin_ctz(lanes);
+        store_lane(batch, lane, batch->cpu[lane], 0xFFFFU, true);
+    }
+}
@@ -1,184 +1,361 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include "cpu.h"
+#include "hash.h"
 #include "instr.h"
 
-struct cpu* cpu_create(void) {
-    struct cpu* cpu = malloc(sizeof(struct cpu));
-    if (!cpu) {
-        return NULL;
+_Static_assert(offsetof(struct cpu, page) == 64,
+               "registers must fit in the first cache line");
+_Static_assert(offsetof(struct cpu, pool) == 0x148 &&
+                   offsetof(struct cpu, display) == 0x180,
+               "keep the layout in cpu.h in sync");
+_Static_assert(sizeof(struct cpu) == 448, "instance grew past 448 bytes");
+
+// a display taken from the pool, refcounted like pooled pages
+struct display_block {
+    struct display display;
+    uint32_t refs;
+};
+
+int32_t cpu_pool_init(struct cpu_pool* pool, size_t instances_per_chunk) {
+    if (!pool) {
+        return 1;
     }
-    if (cpu_init(cpu) != 0) {
-        free(cpu);
-        return NULL;
+    if (pool_init(&pool->cpus, sizeof(struct cpu), _Alignof(struct cpu),
+                  instances_per_chunk) != 0) {
+        return 1;
     }
-    return cpu;
+    // a game usually writes one or two pages, size the page chunks alike
+    if (pool_init(&pool->pages, sizeof(struct page), _Alignof(struct page),
+                  instances_per_chunk * 2) != 0) {
+        pool_destroy(&pool->cpus);
+        return 1;
+    }
+    // nothing is allocated until an instance asks, so these cost nothing
+    // for pools that never run XO-CHIP or never draw
+    if (pool_init(&pool->large_pages, sizeof(struct large_page),
+                  _Alignof(struct large_page), instances_per_chunk) != 0 ||
+        pool_init(&pool->displays, sizeof(struct display_block),
+                  _Alignof(struct display_block), instances_per_chunk) != 0) {
+        pool_destroy(&pool->pages);
+        pool_destroy(&pool->cpus);
+        return 1;
+    }
+    return 0;
 }
 
-int32_t cpu_init(struct cpu* cpu) {
-    if (!cpu) {
-        return 1;
+void cpu_pool_destroy(struct cpu_pool* pool) {
+    if (!pool) {
+        return;
     }
+    pool_destroy(&pool->displays);
+    pool_destroy(&pool->large_pages);
+    pool_destroy(&pool->pages);
+    pool_destroy(&pool->cpus);
+}
 
-    struct graphics* graphics = graphics_create();
-    if (!graphics) {
-        return 1;
+struct cpu* cpu_create(struct cpu_pool* pool) {
+    struct cpu* cpu = pool_alloc(&pool->cpus);
+    if (!cpu) {
+        return NULL;
     }
+    if (cpu_init(cpu, pool) != 0) {
+        pool_free(&pool->cpus, cpu);
+        return NULL;
+    }
+    return cpu;
+}
 
-    struct audio* audio = audio_create();
-    if (!audio) {
-        graphics_destroy(graphics);
+int32_t cpu_init(struct cpu* cpu, struct cpu_pool* pool) {
+    if (!cpu || !pool) {
         return 1;
     }
 
     *cpu = (struct cpu){
-        .pc = 0x200,
+        .pc = APP_MEMORY_OFFSET,
         .i = 0,
         .sp = 0,
         .v = {0},
-        .dt = 0,
-        .st = 0,
-        .ram = {0},
         .stack = {0},
-        .key = {0},
-        .graphics = graphics,
-        .audio = audio,
+        .key = 0,
+        .draw_flag = true,
+        .pool = pool,
+        .clock_rate = CPU_CLOCK_RATE,
+        .memory_mask = MEMORY_MASK,
+        .page_shift = PAGE_SHIFT,
+        .mode = CPU_CHIP8,
+        .display = &display_blank[0],
+        .display_unhashed = true,
+        .planes = 1,
     };
+    mem_init(cpu);
+
+    cpu_seed(cpu, (uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)cpu);
+    return 0;
+}
 
-    const size_t fontset_size =
-        sizeof(chip8_fontset) / sizeof(chip8_fontset[0]);
-    for (size_t i = 0; i < fontset_size; ++i) {
-        cpu->ram[i] = chip8_fontset[i];
+// drops the display and shows a blank one in the given resolution
+static void display_release(struct cpu* cpu, bool hires) {
+    if (cpu->display_pooled) {
+        struct display_block* block = (struct display_block*)cpu->display;
+        if (__atomic_sub_fetch(&block->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+            pool_free(&cpu->pool->displays, block);
+        }
     }
+    cpu->display = &display_blank[hires];
+    cpu->display_pooled = false;
+    cpu->display_owned = false;
+    cpu->display_unhashed = true;
+    cpu->display_writes++;
+}
 
-    srandom(time(NULL));
-    return 0;
+static struct display* display_unshare(struct cpu* cpu);
+
+// the display to draw on, copied first unless the instance is its only
+// holder. NULL when out of memory.
+static inline struct display* display_write(struct cpu* cpu) {
+    cpu->draw_flag = true;
+    cpu->display_unhashed = true;
+    cpu->display_writes++;
+    if (cpu->display_owned) {
+        return (struct display*)cpu->display;
+    }
+    return display_unshare(cpu);
+}
+
+static struct display* display_unshare(struct cpu* cpu) {
+    struct display_block* block = (struct display_block*)cpu->display;
+    if (cpu->display_pooled &&
+        __atomic_load_n(&block->refs, __ATOMIC_ACQUIRE) == 1) {
+        cpu->display_owned = true;
+        return &block->display;
+    }
+
+    struct display_block* copy = pool_alloc(&cpu->pool->displays);
+    if (!copy) {
+        fputs("Memory error", stderr);
+        return NULL;
+    }
+    memcpy(&copy->display, cpu->display, sizeof(struct display));
+    copy->refs = 1;
+    display_release(cpu, false);
+    cpu->display = &copy->display;
+    cpu->display_pooled = true;
+    cpu->display_owned = true;
+    return &copy->display;
 }
 
 void cpu_destroy(struct cpu* cpu) {
     if (!cpu) {
         return;
     }
-    audio_destroy(cpu->audio);
-    graphics_destroy(cpu->graphics);
-    free(cpu);
+    mem_release(cpu);
+    display_release(cpu, false);
+    pool_free(&cpu->pool->cpus, cpu);
 }
 
-static int64_t get_file_size(FILE* file) {
-    const int32_t result = fseek(file, 0, SEEK_END);
-    if (result != 0) {
-        return -1;
+void cpu_set_mode(struct cpu* cpu, uint8_t mode) {
+    if (mode >= CPU_MODES) {
+        return;
     }
-
-    long file_size = ftell(file);
-    rewind(file);
-    return file_size;
+    mem_release(cpu);
+    display_release(cpu, false);
+    cpu->mode = mode;
+    cpu->page_shift = mode == CPU_XOCHIP ? PAGE_MAX_SHIFT : PAGE_SHIFT;
+    cpu->memory_mask = mode == CPU_XOCHIP ? MEMORY_MAX_MASK : MEMORY_MASK;
+    cpu->planes = 1;
+    mem_init(cpu);
 }
 
-bool cpu_load_application(struct cpu* cpu, const char* filename) {
-    FILE* file = fopen(filename, "rbe");
-    if (file == NULL) {
-        fputs("File error", stderr);
-        return false;
-    }
+static const char* const mode_names[CPU_MODES] = {
+    [CPU_CHIP8] = "chip8",
+    [CPU_SCHIP] = "schip",
+    [CPU_XOCHIP] = "xochip",
+};
 
-    int64_t file_size = get_file_size(file);
-    if (file_size < 0) {
-        printf("Error: failed to get ROM size");
-        fclose(file);
-        return false;
+const char* cpu_mode_name(uint8_t mode) {
+    return mode < CPU_MODES ? mode_names[mode] : "?";
+}
+
+uint8_t cpu_mode_from_name(const char* name) {
+    uint8_t mode = 0;
+    while (mode < CPU_MODES && strcmp(name, mode_names[mode]) != 0) {
+        mode++;
     }
+    return mode;
+}
 
-    if (file_size > 4096 - 512) {
+bool cpu_load_application(struct cpu* cpu, const struct rom* rom) {
+    const uint32_t page_size = cpu_page_size(cpu);
+    if (rom->size > cpu->memory_mask + 1U - APP_MEMORY_OFFSET) {
         printf("Error: ROM too big for memory");
-        fclose(file);
         return false;
     }
 
-    uint8_t* buffer = (uint8_t*)malloc(sizeof(uint8_t) * file_size);
-    if (buffer == NULL) {
-        fputs("Memory error", stderr);
-        fclose(file);
-        return false;
+    // ROM data is only padded to whole PAGE_SIZE pages, so large pages
+    // reaching past it, or holding the font as well, get a private copy
+    const size_t padded = (rom->size + PAGE_MASK) & ~(size_t)PAGE_MASK;
+    const size_t end = APP_MEMORY_OFFSET + padded;
+    for (uint32_t n = 0; n < PAGE_COUNT; ++n) {
+        const size_t base = (size_t)n * page_size;
+        if (base + page_size <= APP_MEMORY_OFFSET) {
+            continue;
+        }
+        if (base >= end) {
+            mem_map(cpu, n, mem_zero_page);
+        } else if (base >= APP_MEMORY_OFFSET && base + page_size <= end) {
+            mem_map(cpu, n, &rom->data[base - APP_MEMORY_OFFSET]);
+        } else if (mem_unshare(cpu, n)) {
+            const size_t from = base > APP_MEMORY_OFFSET ? base
+                                                         : APP_MEMORY_OFFSET;
+            const size_t to = base + page_size < end ? base + page_size : end;
+            memset(&cpu->page[n][from - base], 0, page_size - (from - base));
+            memcpy(&cpu->page[n][from - base],
+                   &rom->data[from - APP_MEMORY_OFFSET], to - from);
+            cpu->page_unhashed |= 1U << n;
+        }
     }
+    cpu_checkpoint(cpu);
+    return true;
+}
 
-    size_t len = fread(buffer, 1, file_size, file);
-    if (len != (uint64_t)file_size) {
-        fputs("Reading error", stderr);
-        fclose(file);
-        free(buffer);
-        return false;
+void cpu_checkpoint(struct cpu* cpu) {
+    cpu->page_dirty = 0;
+}
+
+uint16_t cpu_dirty_pages(const struct cpu* cpu) {
+    return cpu->page_dirty;
+}
+
+const uint8_t* cpu_page_data(const struct cpu* cpu, uint32_t page) {
+    return cpu->page[page % PAGE_COUNT];
+}
+
+uint32_t cpu_share_clean_pages(struct cpu* cpu, struct cpu* other) {
+    uint32_t shared = 0;
+    if (cpu->mode != other->mode) {
+        return 0;
+    }
+    for (uint32_t n = 0; n < PAGE_COUNT; ++n) {
+        if (cpu->page_dirty & (1U << n)) {
+            continue;
+        }
+        if (cpu->page[n] != other->page[n] &&
+            memcmp(cpu->page[n], other->page[n], cpu_page_size(cpu)) != 0) {
+            continue;
+        }
+        mem_share(cpu, n, other);
+        shared++;
     }
+    return shared;
+}
 
-    memmove(&cpu->ram[512], buffer, file_size * sizeof(uint8_t));
+uint64_t cpu_state_hash(struct cpu* cpu) {
+    mem_hash(cpu);
+
+    // bitfields have unspecified padding, so hash a copy of the registers
+    struct {
+        uint8_t v[16];
+        uint16_t stack[16];
+        uint16_t i;
+        uint16_t pc;
+        uint8_t sp;
+        uint8_t dt;
+        uint8_t st;
+        uint8_t planes;
+        uint32_t rng;
+        uint8_t flags[16];
+    } regs = {.i = cpu->i, .pc = cpu->pc, .sp = cpu->sp, .dt = cpu_dt(cpu),
+              .st = cpu_st(cpu), .planes = cpu->planes, .rng = cpu->rng};
+    memcpy(regs.v, cpu->v, sizeof(regs.v));
+    memcpy(regs.stack, cpu->stack, sizeof(regs.stack));
+    memcpy(regs.flags, cpu->flags, sizeof(regs.flags));
+
+    // the display only changes on drawing, keep its hash until then
+    if (cpu->display_unhashed) {
+        cpu->display_hash = hash_bytes(cpu->display, sizeof(struct display),
+                                       cpu->mode);
+        cpu->display_unhashed = false;
+    }
+    uint64_t h = hash_bytes(&regs, sizeof(regs), 0);
+    h = hash_mix(h ^ cpu->display_hash);
+    for (uint32_t n = 0; n < PAGE_COUNT; ++n) {
+        h = hash_mix(h ^ cpu->page_hash[n]);
+    }
+    return h;
+}
 
-    fclose(file);
-    free(buffer);
-    return true;
+static inline uint8_t ram_read(const struct cpu* cpu, uint16_t addr) {
+    return cpu_peek(cpu, addr);
 }
 
-void cpu_handle_sdl_key_event(struct cpu* cpu, SDL_Event event) {
-    bool key_value = false;
-    if (event.type == SDL_KEYDOWN) {
-        key_value = true;
-    } else if (event.type != SDL_KEYUP) {
-        printf("Unknown input event: %d", event.type);
+static inline void ram_write(struct cpu* cpu, uint16_t addr, uint8_t value) {
+    addr &= cpu->memory_mask;
+    const uint32_t page = addr >> cpu->page_shift;
+    const uint16_t bit = 1U << page;
+    if (!(cpu->page_owned & bit) && !mem_unshare(cpu, page)) {
         return;
     }
+    cpu->page[page][addr & (cpu_page_size(cpu) - 1)] = value;
+    cpu->page_dirty |= bit;
+    cpu->page_unhashed |= bit;
+}
 
-    uint8_t keycode = 0;
-    switch (event.key.keysym.sym) {
-    case SDLK_1:
-        keycode = 0x1;
-        break;
-    case SDLK_2:
-        keycode = 0x2;
-        break;
-    case SDLK_3:
-        keycode = 0x3;
-        break;
-    case SDLK_4:
-        keycode = 0xC;
-        break;
-    case SDLK_q:
-        keycode = 0x4;
-        break;
-    case SDLK_w:
-        keycode = 0x5;
-        break;
-    case SDLK_e:
-        keycode = 0x6;
-        break;
-    case SDLK_r:
-        keycode = 0xD;
-        break;
-    case SDLK_a:
-        keycode = 0x7;
-        break;
-    case SDLK_s:
-        keycode = 0x8;
-        break;
-    case SDLK_d:
-        keycode = 0x9;
-        break;
-    case SDLK_f:
-        keycode = 0xE;
-        break;
-    case SDLK_z:
-        keycode = 0xA;
-        break;
-    case SDLK_x:
-        keycode = 0x0;
-        break;
-    case SDLK_c:
-        keycode = 0xB;
-        break;
-    case SDLK_v:
-        keycode = 0xF;
-        break;
-    default:
-        return;
+void cpu_set_key(struct cpu* cpu, uint8_t key, bool pressed) {
+    if (pressed) {
+        cpu->key |= 1U << (key & 0xFU);
+    } else {
+        cpu->key &= ~(1U << (key & 0xFU));
     }
-    cpu->key[keycode] = key_value;
+}
+
+struct cpu* cpu_fork(struct cpu* cpu, struct cpu_pool* pool) {
+    struct cpu* child = pool_alloc(&pool->cpus);
+    if (!child) {
+        return NULL;
+    }
+    memcpy(child, cpu, sizeof(struct cpu));
+    child->pool = pool;
+    child->trace = NULL;
+
+    // both sides now hold every pooled page and the display, so neither may
+    // write them in place
+    for (uint32_t pooled = cpu->page_pooled; pooled; pooled &= pooled - 1) {
+        mem_retain(cpu, __builtin_ctz(pooled));
+    }
+    cpu->page_owned = 0;
+    child->page_owned = 0;
+    if (cpu->display_pooled) {
+        struct display_block* block = (struct display_block*)cpu->display;
+        __atomic_add_fetch(&block->refs, 1, __ATOMIC_RELAXED);
+    }
+    cpu->display_owned = false;
+    child->display_owned = false;
+    return child;
+}
+
+void cpu_seed(struct cpu* cpu, uint32_t seed) {
+    // xorshift gets stuck on zero
+    cpu->rng = seed ? seed : 0x2545F491U;
+}
+
+static inline uint32_t next_random(struct cpu* cpu) {
+    uint32_t x = cpu->rng;
+    x ^= x << 13U;
+    x ^= x >> 17U;
+    x ^= x << 5U;
+    cpu->rng = x;
+    return x;
+}
+
+// skips the next instruction, XO-CHIP's F000 NNNN is 4 bytes long
+static inline void skip_next(struct cpu* cpu) {
+    const bool long_next = cpu->mode == CPU_XOCHIP &&
+                           ram_read(cpu, cpu->pc + 2) == 0xF0U &&
+                           ram_read(cpu, cpu->pc + 3) == 0x00U;
+    cpu->pc += long_next ? 6 : 4;
 }
 
 // ops
@@ -190,12 +367,81 @@ static void op_call_nnn(struct cpu* cpu, union instr instr) {
     cpu->pc = instr.nnn;
 }
 
-// 00E0
+// 00E0, XO-CHIP only clears the selected planes
 static void op_cls(struct cpu* cpu) {
-    for (int32_t i = 0; i < 2048; ++i) {
-        cpu->graphics->vram[i] = 0;
+    const bool hires = cpu->display->width == DISPLAY_MAX_WIDTH;
+    // only XO-CHIP ever draws to plane 1
+    const uint32_t lit =
+        cpu->mode == CPU_XOCHIP ? (1U << DISPLAY_PLANES) - 1 : 1;
+    if ((cpu->planes & lit) == lit && !cpu->display_owned) {
+        // no need for a copy of a display that is about to be blank
+        display_release(cpu, hires);
+        cpu->draw_flag = true;
+    } else {
+        // an owned display is cleared in place, rows past the height of a
+        // lores display stay blank anyway
+        const size_t size = cpu->display->height * sizeof(display_row);
+        struct display* display = display_write(cpu);
+        for (uint32_t p = 0; display && p < DISPLAY_PLANES; ++p) {
+            if (cpu->planes & (1U << p)) {
+                memset(display->rows[p], 0, size);
+            }
+        }
+    }
+    cpu->pc += 2;
+}
+
+// columns of the display within a row
+static inline display_row visible_columns(const struct display* display) {
+    return ~(display_row)0 << (DISPLAY_MAX_WIDTH - display->width);
+}
+
+// 00CN and XO-CHIP's 00DN, by N pixels of the current resolution
+static void op_scroll_vertical(struct cpu* cpu, uint32_t n, bool down) {
+    struct display* display = display_write(cpu);
+    if (display) {
+        const uint32_t height = display->height;
+        n = n < height ? n : height;
+        for (uint32_t p = 0; p < DISPLAY_PLANES; ++p) {
+            if (!(cpu->planes & (1U << p))) {
+                continue;
+            }
+            display_row* rows = display->rows[p];
+            const size_t kept = (height - n) * sizeof(display_row);
+            if (down) {
+                memmove(&rows[n], rows, kept);
+                memset(rows, 0, n * sizeof(display_row));
+            } else {
+                memmove(rows, &rows[n], kept);
+                memset(&rows[height - n], 0, n * sizeof(display_row));
+            }
+        }
+    }
+    cpu->pc += 2;
+}
+
+// 00FB and 00FC, 4 pixels
+static void op_scroll_horizontal(struct cpu* cpu, bool right) {
+    struct display* display = display_write(cpu);
+    if (display) {
+        const display_row visible = visible_columns(display);
+        for (uint32_t p = 0; p < DISPLAY_PLANES; ++p) {
+            if (!(cpu->planes & (1U << p))) {
+                continue;
+            }
+            display_row* rows = display->rows[p];
+            for (uint32_t y = 0; y < display->height; ++y) {
+                rows[y] = right ? (rows[y] >> 4U) & visible : rows[y] << 4U;
+            }
+        }
     }
-    cpu->graphics->draw_flag = true;
+    cpu->pc += 2;
+}
+
+// 00FE and 00FF, switching clears the display
+static void op_resolution(struct cpu* cpu, bool hires) {
+    display_release(cpu, hires);
+    cpu->draw_flag = true;
     cpu->pc += 2;
 }
 
@@ -214,7 +460,7 @@ static void op_jmp_nnn(struct cpu* cpu, union instr instr) {
 // 3XNN
 static void op_se_vx_nn(struct cpu* cpu, union instr instr) {
     if (cpu->v[instr.x] == instr.nn) {
-        cpu->pc += 4;
+        skip_next(cpu);
     } else {
         cpu->pc += 2;
     }
@@ -223,7 +469,7 @@ static void op_se_vx_nn(struct cpu* cpu, union instr instr) {
 // 4XNN
 static void op_sne_vx_nn(struct cpu* cpu, union instr instr) {
     if (cpu->v[instr.x] != instr.nn) {
-        cpu->pc += 4;
+        skip_next(cpu);
     } else {
         cpu->pc += 2;
     }
@@ -232,7 +478,7 @@ static void op_sne_vx_nn(struct cpu* cpu, union instr instr) {
 // 5XY0 SE
 static void op_se_vx_vy(struct cpu* cpu, union instr instr) {
     if (cpu->v[instr.x] == cpu->v[instr.y]) {
-        cpu->pc += 4;
+        skip_next(cpu);
     } else {
         cpu->pc += 2;
     }
@@ -337,7 +583,7 @@ static void op_shl_vx_vy(struct cpu* cpu, union instr instr) {
 // 9XY0
 static void op_sne_vx_vy(struct cpu* cpu, union instr instr) {
     if (cpu->v[instr.x] != cpu->v[instr.y]) {
-        cpu->pc += 4;
+        skip_next(cpu);
     } else {
         cpu->pc += 2;
     }
@@ -349,55 +595,104 @@ static void op_ld_i_nnn(struct cpu* cpu, union instr instr) {
     cpu->pc += 2;
 }
 
-// BNNN
+// BNNN, BXNN on SUPER-CHIP
 static void op_jmp_v0_nnn(struct cpu* cpu, union instr instr) {
-    cpu->pc = instr.nnn + cpu->v[0];
+    cpu->pc = instr.nnn + cpu->v[cpu->mode == CPU_SCHIP ? instr.x : 0];
 }
 
 // CXNN
 static void op_rnd_vx_nn(struct cpu* cpu, union instr instr) {
     // rand returns a 32bit integer
     // so we have to ensure we get a number less than 255
-    cpu->v[instr.x] = instr.nn & ((uint32_t)random() % 0xFFU);
+    cpu->v[instr.x] = instr.nn & (next_random(cpu) % 0xFFU);
     cpu->pc += 2;
 }
 
-// DXYN
-static void op_drw_vx_vy_n(struct cpu* cpu, union instr instr) {
-    uint8_t vx = cpu->v[instr.x];
-    uint8_t vy = cpu->v[instr.y];
+// DXYN, and DXY0 for a 16x16 sprite on SUPER-CHIP and XO-CHIP. with both
+// XO-CHIP planes selected the sprite for plane 1 follows the one for plane 0.
+// inlined for CHIP-8 and once per resolution, so mode and sizes are
+// constants and plain CHIP-8 is a single plane of 8 wide sprites.
+static inline __attribute__((always_inline)) void
+draw_sprite(struct cpu* cpu, union instr instr, enum cpu_mode mode,
+            uint32_t width, uint32_t height) {
+    const bool wide = instr.n == 0 && mode != CPU_CHIP8;
+    const uint32_t rows = wide ? 16 : instr.n;
+    const uint32_t bytes = wide ? 2 : 1;
+    // SUPER-CHIP clips sprites at the edges, the others wrap around
+    const bool clip = mode == CPU_SCHIP;
+    const uint32_t planes = mode == CPU_XOCHIP ? cpu->planes : 1;
+    // both resolutions are powers of two
+    const uint32_t vx = cpu->v[instr.x] & (width - 1);
+    const uint32_t vy = cpu->v[instr.y] & (height - 1);
+    // how far to shift the sprite left to wrap what goes past the edge
+    const uint32_t wrap = (width - vx) & (width - 1);
 
     cpu->v[0xF] = 0;
-    for (uint32_t i = 0; i < instr.n; i++) {
-        uint8_t sprite = cpu->ram[cpu->i + i];
-        uint8_t y = (vy + i) % SCREEN_HEIGHT;
-
-        for (uint32_t j = 0; j < 8; j++) {
-            uint8_t x = (vx + j) % SCREEN_WIDTH;
-            size_t addr = y * SCREEN_WIDTH + x;
-            uint8_t sprite_pixel = (sprite & 0x80U) >> 7U;
-
-            if (sprite_pixel == 1) {
-                uint32_t curr_pixel = cpu->graphics->vram[addr];
-                if (curr_pixel != 0) {
-                    cpu->v[0xF] = 1;
-                    cpu->graphics->vram[addr] = 0;
-                } else {
-                    cpu->graphics->vram[addr] = 1;
+    struct display* display = NULL;
+    uint16_t addr = cpu->i;
+    for (uint32_t p = 0; p < DISPLAY_PLANES; ++p) {
+        if (!(planes & (1U << p))) {
+            continue;
+        }
+        for (uint32_t i = 0; i < rows; i++, addr += bytes) {
+            uint32_t sprite = ram_read(cpu, addr);
+            if (wide) {
+                sprite = sprite << 8U | ram_read(cpu, addr + 1);
+            }
+            if (sprite == 0 || (clip && vy + i >= height)) {
+                continue;
+            }
+
+            // the sprite moved right by vx, and unless clipped whatever
+            // went past the right edge comes back in on the left
+            display_row bits;
+            if (width == SCREEN_WIDTH) {
+                // lores only touches the top half of a row
+                const uint64_t left = (uint64_t)sprite
+                                      << (SCREEN_WIDTH - 8 * bytes);
+                uint64_t half = left >> vx;
+                if (!clip) {
+                    half |= left << wrap;
                 }
-                cpu->graphics->draw_flag = true;
+                bits = (display_row)half << SCREEN_WIDTH;
+            } else {
+                const display_row left = (display_row)sprite
+                                         << (DISPLAY_MAX_WIDTH - 8 * bytes);
+                bits = left >> vx;
+                if (!clip) {
+                    bits |= left << wrap;
+                }
+            }
+
+            if (!display && !(display = display_write(cpu))) {
+                return;
             }
-            sprite <<= 1U;
+            display_row* row = &display->rows[p][(vy + i) & (height - 1)];
+            if (*row & bits) {
+                cpu->v[0xF] = 1;
+            }
+            *row ^= bits;
         }
     }
+}
 
+static void op_drw_vx_vy_n(struct cpu* cpu, union instr instr) {
+    if (cpu->mode == CPU_CHIP8) {
+        draw_sprite(cpu, instr, CPU_CHIP8, SCREEN_WIDTH, SCREEN_HEIGHT);
+    } else if (cpu->display->width == DISPLAY_MAX_WIDTH) {
+        draw_sprite(cpu, instr, cpu->mode, DISPLAY_MAX_WIDTH,
+                    DISPLAY_MAX_HEIGHT);
+    } else {
+        draw_sprite(cpu, instr, cpu->mode, SCREEN_WIDTH, SCREEN_HEIGHT);
+    }
     cpu->pc += 2;
 }
 
 // EX9E
 static void op_skp_vx(struct cpu* cpu, union instr instr) {
-    if (cpu->key[cpu->v[instr.x]]) {
-        cpu->pc += 4;
+    cpu->key_read |= 1U << (cpu->v[instr.x] & 0xFU);
+    if (cpu->key & (1U << (cpu->v[instr.x] & 0xFU))) {
+        skip_next(cpu);
     } else {
         cpu->pc += 2;
     }
@@ -405,8 +700,9 @@ static void op_skp_vx(struct cpu* cpu, union instr instr) {
 
 // EXA1
 static void op_sknp_vx(struct cpu* cpu, union instr instr) {
-    if (!cpu->key[cpu->v[instr.x]]) {
-        cpu->pc += 4;
+    cpu->key_read |= 1U << (cpu->v[instr.x] & 0xFU);
+    if (!(cpu->key & (1U << (cpu->v[instr.x] & 0xFU)))) {
+        skip_next(cpu);
     } else {
         cpu->pc += 2;
     }
@@ -414,15 +710,16 @@ static void op_sknp_vx(struct cpu* cpu, union instr instr) {
 
 // FX07
 static void op_ld_vx_dt(struct cpu* cpu, union instr instr) {
-    cpu->v[instr.x] = cpu->dt;
+    cpu->v[instr.x] = cpu_dt(cpu);
     cpu->pc += 2;
 }
 
 // FX0A
 static void op_ld_vx_key(struct cpu* cpu, union instr instr) {
+    cpu->key_read = 0xFFFFU;
     bool key_press = false;
     for (int32_t i = 0; i < 16; i++) {
-        if (cpu->key[i]) {
+        if (cpu->key & (1U << i)) {
             cpu->v[instr.x] = i;
             key_press = true;
         }
@@ -437,13 +734,13 @@ static void op_ld_vx_key(struct cpu* cpu, union instr instr) {
 
 // FX15
 static void op_ld_dt_vx(struct cpu* cpu, union instr instr) {
-    cpu->dt = cpu->v[instr.x];
+    cpu->dt_end = cpu_ticks(cpu) + cpu->v[instr.x];
     cpu->pc += 2;
 }
 
 // FX18
 static void op_ld_st_vx(struct cpu* cpu, union instr instr) {
-    cpu->st = cpu->v[instr.x];
+    cpu->st_end = cpu_ticks(cpu) + cpu->v[instr.x];
     cpu->pc += 2;
 }
 
@@ -463,46 +760,147 @@ static void op_ld_i_font_vx(struct cpu* cpu, union instr instr) {
 static void op_bcd_vx(struct cpu* cpu, union instr instr) {
     uint8_t x = cpu->v[instr.x];
     uint16_t i = cpu->i;
-    cpu->ram[i + 0] = x / 100;
-    cpu->ram[i + 1] = (x / 10) % 10;
-    cpu->ram[i + 2] = (x % 100) % 10;
+    ram_write(cpu, i + 0, x / 100);
+    ram_write(cpu, i + 1, (x / 10) % 10);
+    ram_write(cpu, i + 2, (x % 100) % 10);
     cpu->pc += 2;
 }
 
-// FX55
+// FX55, SUPER-CHIP leaves I alone
 static void op_ld_i_vx(struct cpu* cpu, union instr instr) {
     uint16_t i = cpu->i;
     for (int32_t j = 0; j <= instr.x; j++) {
-        cpu->ram[i + j] = cpu->v[j];
+        ram_write(cpu, i + j, cpu->v[j]);
+    }
+    if (cpu->mode != CPU_SCHIP) {
+        cpu->i += (instr.x + 1);
     }
-    cpu->i += (instr.x + 1);
     cpu->pc += 2;
 }
 
-// FX65
+// FX65, SUPER-CHIP leaves I alone
 static void op_ld_vx_i(struct cpu* cpu, union instr instr) {
     uint16_t i = cpu->i;
     for (int32_t j = 0; j <= instr.x; j++) {
-        cpu->v[j] = cpu->ram[i + j];
+        cpu->v[j] = ram_read(cpu, i + j);
+    }
+    if (cpu->mode != CPU_SCHIP) {
+        cpu->i += (instr.x + 1);
     }
-    cpu->i += (instr.x + 1);
     cpu->pc += 2;
 }
 
-void cpu_update_timers(struct cpu* cpu) {
-    if (cpu->dt > 0) {
-        cpu->dt--;
-    }
-    if (cpu->st > 0) {
-        if (cpu->st == 1) {
-            audio_beep(cpu->audio, 1500);
+// FX30
+static void op_ld_i_big_font_vx(struct cpu* cpu, union instr instr) {
+    cpu->i = FONT_BIG_OFFSET + (cpu->v[instr.x] & 0xFU) * 10;
+    cpu->pc += 2;
+}
+
+// FX75
+static void op_ld_flags_vx(struct cpu* cpu, union instr instr) {
+    memcpy(cpu->flags, cpu->v, instr.x + 1U);
+    cpu->pc += 2;
+}
+
+// FX85
+static void op_ld_vx_flags(struct cpu* cpu, union instr instr) {
+    memcpy(cpu->v, cpu->flags, instr.x + 1U);
+    cpu->pc += 2;
+}
+
+// 5XY2 and 5XY3, VX to VY in either direction, I stays
+static void op_ld_i_vx_vy(struct cpu* cpu, union instr instr, bool load) {
+    const bool up = instr.x <= instr.y;
+    const uint32_t count = (up ? instr.y - instr.x : instr.x - instr.y) + 1U;
+    for (uint32_t n = 0; n < count; ++n) {
+        const uint32_t r = (up ? instr.x + n : instr.x - n) & 0xFU;
+        if (load) {
+            cpu->v[r] = ram_read(cpu, cpu->i + n);
+        } else {
+            ram_write(cpu, cpu->i + n, cpu->v[r]);
         }
-        cpu->st--;
     }
+    cpu->pc += 2;
+}
+
+// F000 NNNN
+static void op_ld_i_nnnn(struct cpu* cpu) {
+    cpu->i = (uint16_t)(ram_read(cpu, cpu->pc + 2) << 8U |
+                        ram_read(cpu, cpu->pc + 3));
+    cpu->pc += 4;
+}
+
+// FN01
+static void op_plane(struct cpu* cpu, union instr instr) {
+    cpu->planes = instr.x & ((1U << DISPLAY_PLANES) - 1);
+    cpu->pc += 2;
+}
+
+// F002
+static void op_ld_pattern_i(struct cpu* cpu) {
+    for (uint32_t n = 0; n < sizeof(cpu->pattern); ++n) {
+        cpu->pattern[n] = ram_read(cpu, cpu->i + n);
+    }
+    cpu->pc += 2;
+}
+
+// FX3A
+static void op_ld_pitch_vx(struct cpu* cpu, union instr instr) {
+    cpu->pitch = cpu->v[instr.x];
+    cpu->pc += 2;
+}
+
+void cpu_set_clock(struct cpu* cpu, uint32_t clock_rate) {
+    if (clock_rate == 0) {
+        return;
+    }
+    const uint8_t dt = cpu_dt(cpu);
+    const uint8_t st = cpu_st(cpu);
+    cpu->clock_rate = clock_rate;
+    cpu->dt_end = cpu_ticks(cpu) + dt;
+    cpu->st_end = cpu_ticks(cpu) + st;
+}
+
+static void unknown_opcode(struct cpu* cpu, uint16_t opcode) {
+    printf("Unknown opcode: 0x%X\n", opcode);
+    cpu->pc += 2;
+}
+
+// 00CN, 00DN and 00FB-00FF, false for anything else
+static bool decode_super_opcode(struct cpu* cpu, uint16_t opcode) {
+    if ((opcode & 0xFFF0U) == 0x00C0U) {
+        op_scroll_vertical(cpu, opcode & 0xFU, true);
+        return true;
+    }
+    if ((opcode & 0xFFF0U) == 0x00D0U && cpu->mode == CPU_XOCHIP) {
+        op_scroll_vertical(cpu, opcode & 0xFU, false);
+        return true;
+    }
+    switch (opcode) {
+    case 0x00FB:
+        op_scroll_horizontal(cpu, true);
+        return true;
+    case 0x00FC:
+        op_scroll_horizontal(cpu, false);
+        return true;
+    case 0x00FD:
+        // exit, the instance stays here for good
+        return true;
+    case 0x00FE:
+        op_resolution(cpu, false);
+        return true;
+    case 0x00FF:
+        op_resolution(cpu, true);
+        return true;
+    }
+    return false;
 }
 
 static void decode_opcode(struct cpu* cpu, uint16_t opcode) {
     union instr instr = {.instr = opcode};
+    // SUPER-CHIP and XO-CHIP opcodes are unknown to plain CHIP-8
+    const bool super = cpu->mode != CPU_CHIP8;
+    const bool xo = cpu->mode == CPU_XOCHIP;
 
     switch (instr.opcode) {
     case 0x0:
@@ -514,8 +912,9 @@ static void decode_opcode(struct cpu* cpu, uint16_t opcode) {
             op_ret(cpu);
             break;
         default:
-            printf("Unknown opcode: 0x%X\n", opcode);
-            cpu->pc += 2;
+            if (!super || !decode_super_opcode(cpu, opcode)) {
+                unknown_opcode(cpu, opcode);
+            }
             return;
         }
         break;
@@ -532,7 +931,11 @@ static void decode_opcode(struct cpu* cpu, uint16_t opcode) {
         op_sne_vx_nn(cpu, instr);
         break;
     case 0x5:
-        op_se_vx_vy(cpu, instr);
+        if (xo && (instr.n == 0x2 || instr.n == 0x3)) {
+            op_ld_i_vx_vy(cpu, instr, instr.n == 0x3);
+        } else {
+            op_se_vx_vy(cpu, instr);
+        }
         break;
     case 0x6:
         op_ld_vx_nn(cpu, instr);
@@ -570,8 +973,7 @@ static void decode_opcode(struct cpu* cpu, uint16_t opcode) {
             op_shl_vx_vy(cpu, instr);
             break;
         default:
-            cpu->pc += 2;
-            printf("Unknown opcode: 0x%X\n", opcode);
+            unknown_opcode(cpu, opcode);
             return;
         }
         break;
@@ -599,13 +1001,33 @@ static void decode_opcode(struct cpu* cpu, uint16_t opcode) {
             op_sknp_vx(cpu, instr);
             break;
         default:
-            cpu->pc += 2;
-            printf("Unknown opcode: 0x%X\n", opcode);
+            unknown_opcode(cpu, opcode);
             return;
         }
         break;
     case 0xF:
         switch (instr.nn) {
+        case 0x00:
+            if (!xo || instr.x != 0) {
+                unknown_opcode(cpu, opcode);
+                return;
+            }
+            op_ld_i_nnnn(cpu);
+            break;
+        case 0x01:
+            if (!xo) {
+                unknown_opcode(cpu, opcode);
+                return;
+            }
+            op_plane(cpu, instr);
+            break;
+        case 0x02:
+            if (!xo || instr.x != 0) {
+                unknown_opcode(cpu, opcode);
+                return;
+            }
+            op_ld_pattern_i(cpu);
+            break;
         case 0x07:
             op_ld_vx_dt(cpu, instr);
             break;
@@ -624,37 +1046,76 @@ static void decode_opcode(struct cpu* cpu, uint16_t opcode) {
         case 0x29:
             op_ld_i_font_vx(cpu, instr);
             break;
+        case 0x30:
+            if (!super) {
+                unknown_opcode(cpu, opcode);
+                return;
+            }
+            op_ld_i_big_font_vx(cpu, instr);
+            break;
         case 0x33:
             op_bcd_vx(cpu, instr);
             break;
+        case 0x3A:
+            if (!xo) {
+                unknown_opcode(cpu, opcode);
+                return;
+            }
+            op_ld_pitch_vx(cpu, instr);
+            break;
         case 0x55:
             op_ld_i_vx(cpu, instr);
             break;
         case 0x65:
             op_ld_vx_i(cpu, instr);
             break;
+        case 0x75:
+            if (!super) {
+                unknown_opcode(cpu, opcode);
+                return;
+            }
+            op_ld_flags_vx(cpu, instr);
+            break;
+        case 0x85:
+            if (!super) {
+                unknown_opcode(cpu, opcode);
+                return;
+            }
+            op_ld_vx_flags(cpu, instr);
+            break;
         default:
-            cpu->pc += 2;
-            printf("Unknown opcode: 0x%X\n", opcode);
+            unknown_opcode(cpu, opcode);
             return;
         }
 
         break;
     default:
-        cpu->pc += 2;
-        printf("Unknown opcode: 0x%X\n", opcode);
+        unknown_opcode(cpu, opcode);
         return;
     }
-
-    // printf("executed opcode: 0x%X\n", opcode);
 }
 
 static inline uint16_t fetch_opcode(struct cpu* cpu) {
-    return (uint32_t)cpu->ram[cpu->pc] << 8U |
-           cpu->ram[cpu->pc + 1];
+    return (uint32_t)ram_read(cpu, cpu->pc) << 8U |
+           ram_read(cpu, cpu->pc + 1);
 }
 
 void cpu_emulate_cycle(struct cpu* cpu) {
+    const uint16_t pc = cpu->pc;
     uint16_t opcode = fetch_opcode(cpu);
     decode_opcode(cpu, opcode);
+    cpu->pc &= cpu->memory_mask;
+    cpu->i &= cpu->memory_mask;
+    cpu->cycles++;
+
+    if (cpu->trace) {
+        const uint8_t x = (opcode >> 8U) & 0xFU;
+        trace_append(cpu->trace, (struct trace_record){
+                                     .pc = pc,
+                                     .opcode = opcode,
+                                     .i = cpu->i,
+                                     .reg = x,
+                                     .value = cpu->v[x],
+                                 });
+    }
 }
@@ -0,0 +1,368 @@
+#include "debug.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char* const kind_names[] = {
+    [DEBUG_NONE] = "deleted",
+    [DEBUG_BREAK] = "break",
+    [DEBUG_READ] = "watch r",
+    [DEBUG_WRITE] = "watch w",
+    [DEBUG_ACCESS] = "watch rw",
+};
+
+// ranges with hi below lo wrap around the end of memory
+static inline void map_set(uint64_t* map, uint16_t lo, uint16_t hi) {
+    const uint32_t len = ((hi - lo) & MEMORY_MAX_MASK) + 1U;
+    for (uint32_t n = 0; n < len; ++n) {
+        const uint32_t addr = (lo + n) & MEMORY_MAX_MASK;
+        map[addr / 64] |= 1ULL << (addr % 64);
+    }
+}
+
+static inline bool map_test(const uint64_t* map, uint16_t addr) {
+    addr &= MEMORY_MAX_MASK;
+    return map[addr / 64] & (1ULL << (addr % 64));
+}
+
+static void rebuild(struct debugger* debugger) {
+    memset(debugger->break_map, 0, sizeof(debugger->break_map));
+    memset(debugger->read_map, 0, sizeof(debugger->read_map));
+    memset(debugger->write_map, 0, sizeof(debugger->write_map));
+    debugger->active = false;
+
+    for (uint32_t n = 0; n < debugger->count; ++n) {
+        const struct debug_point* point = &debugger->points[n];
+        if (point->kind == DEBUG_BREAK) {
+            map_set(debugger->break_map, point->lo, point->hi);
+        }
+        if (point->kind == DEBUG_READ || point->kind == DEBUG_ACCESS) {
+            map_set(debugger->read_map, point->lo, point->hi);
+        }
+        if (point->kind == DEBUG_WRITE || point->kind == DEBUG_ACCESS) {
+            map_set(debugger->write_map, point->lo, point->hi);
+        }
+        debugger->active |= point->kind != DEBUG_NONE;
+    }
+}
+
+void debug_init(struct debugger* debugger) {
+    memset(debugger, 0, sizeof(struct debugger));
+    debugger->stopped = -1;
+}
+
+int32_t debug_add(struct debugger* debugger, const struct debug_point* point) {
+    int32_t id = -1;
+    for (uint32_t n = 0; n < debugger->count; ++n) {
+        if (debugger->points[n].kind == DEBUG_NONE) {
+            id = (int32_t)n;
+            break;
+        }
+    }
+    if (id < 0) {
+        if (debugger->count == DEBUG_MAX_POINTS) {
+            return -1;
+        }
+        id = (int32_t)debugger->count++;
+    }
+    debugger->points[id] = *point;
+    debugger->points[id].lo &= MEMORY_MAX_MASK;
+    debugger->points[id].hi &= MEMORY_MAX_MASK;
+    debugger->points[id].hits = 0;
+    rebuild(debugger);
+    return id;
+}
+
+bool debug_delete(struct debugger* debugger, int32_t id) {
+    if (id < 0 || (uint32_t)id >= debugger->count ||
+        debugger->points[id].kind == DEBUG_NONE) {
+        return false;
+    }
+    debugger->points[id].kind = DEBUG_NONE;
+    rebuild(debugger);
+    return true;
+}
+
+static const char* skip_spaces(const char* text) {
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    return text;
+}
+
+static bool parse_operand(const char** text, struct debug_operand* operand) {
+    const char* s = skip_spaces(*text);
+    char* end = NULL;
+    *operand = (struct debug_operand){0};
+
+    if ((s[0] == 'V' || s[0] == 'v') && isxdigit((unsigned char)s[1]) &&
+        !isalnum((unsigned char)s[2])) {
+        operand->kind = DEBUG_V;
+        operand->reg = (uint8_t)(isdigit((unsigned char)s[1])
+                                     ? s[1] - '0'
+                                     : toupper((unsigned char)s[1]) - 'A' + 10);
+        *text = s + 2;
+        return true;
+    }
+    static const struct {
+        const char* name;
+        uint8_t kind;
+    } names[] = {
+        {"PC", DEBUG_PC}, {"DT", DEBUG_DT}, {"ST", DEBUG_ST}, {"I", DEBUG_I},
+    };
+    for (uint32_t n = 0; n < sizeof(names) / sizeof(names[0]); ++n) {
+        const size_t len = strlen(names[n].name);
+        if (strncasecmp(s, names[n].name, len) == 0 &&
+            !isalnum((unsigned char)s[len])) {
+            operand->kind = names[n].kind;
+            *text = s + len;
+            return true;
+        }
+    }
+    if (s[0] == '[') {
+        const unsigned long addr = strtoul(s + 1, &end, 0);
+        end = (char*)skip_spaces(end);
+        if (end == s + 1 || *end != ']') {
+            return false;
+        }
+        operand->kind = DEBUG_RAM;
+        operand->value = (uint16_t)(addr & MEMORY_MAX_MASK);
+        *text = end + 1;
+        return true;
+    }
+    const unsigned long value = strtoul(s, &end, 0);
+    if (end == s || value > 0xFFFF) {
+        return false;
+    }
+    operand->kind = DEBUG_CONST;
+    operand->value = (uint16_t)value;
+    *text = end;
+    return true;
+}
+
+static bool parse_compare(const char** text, uint8_t* compare) {
+    static const struct {
+        const char* op;
+        uint8_t compare;
+    } ops[] = {
+        // two character operators first so < doesn't match <=
+        {"==", DEBUG_EQ}, {"!=", DEBUG_NE}, {"<=", DEBUG_LE},
+        {">=", DEBUG_GE}, {"<", DEBUG_LT},  {">", DEBUG_GT},
+    };
+    const char* s = skip_spaces(*text);
+    for (uint32_t n = 0; n < sizeof(ops) / sizeof(ops[0]); ++n) {
+        const size_t len = strlen(ops[n].op);
+        if (strncmp(s, ops[n].op, len) == 0) {
+            *compare = ops[n].compare;
+            *text = s + len;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool debug_parse_condition(const char* text,
+                           struct debug_condition* condition) {
+    condition->count = 0;
+    text = skip_spaces(text);
+    if (*text == '\0' || *text == '\n') {
+        return true;
+    }
+    while (true) {
+        if (condition->count == DEBUG_MAX_CLAUSES) {
+            return false;
+        }
+        struct debug_clause* clause = &condition->clauses[condition->count];
+        if (!parse_operand(&text, &clause->left) ||
+            !parse_compare(&text, &clause->compare) ||
+            !parse_operand(&text, &clause->right)) {
+            return false;
+        }
+        condition->count++;
+
+        text = skip_spaces(text);
+        if (*text == '\0' || *text == '\n') {
+            return true;
+        }
+        if (strncmp(text, "&&", 2) != 0) {
+            return false;
+        }
+        text += 2;
+    }
+}
+
+static uint16_t operand_value(const struct debug_operand* operand,
+                              const struct cpu* cpu) {
+    switch (operand->kind) {
+    case DEBUG_V:
+        return cpu->v[operand->reg];
+    case DEBUG_I:
+        return cpu->i;
+    case DEBUG_PC:
+        return cpu->pc;
+    case DEBUG_DT:
+        return cpu_dt(cpu);
+    case DEBUG_ST:
+        return cpu_st(cpu);
+    case DEBUG_RAM:
+        return cpu_peek(cpu, operand->value);
+    default:
+        return operand->value;
+    }
+}
+
+bool debug_check(const struct debug_condition* condition,
+                 const struct cpu* cpu) {
+    for (uint32_t n = 0; n < condition->count; ++n) {
+        const struct debug_clause* clause = &condition->clauses[n];
+        const uint16_t left = operand_value(&clause->left, cpu);
+        const uint16_t right = operand_value(&clause->right, cpu);
+        bool holds = false;
+        switch (clause->compare) {
+        case DEBUG_EQ:
+            holds = left == right;
+            break;
+        case DEBUG_NE:
+            holds = left != right;
+            break;
+        case DEBUG_LT:
+            holds = left < right;
+            break;
+        case DEBUG_LE:
+            holds = left <= right;
+            break;
+        case DEBUG_GT:
+            holds = left > right;
+            break;
+        case DEBUG_GE:
+            holds = left >= right;
+            break;
+        }
+        if (!holds) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// whether addr is in [lo, hi], see map_set
+static bool covers(const struct debug_point* point, uint16_t addr) {
+    return point->lo <= point->hi ? addr >= point->lo && addr <= point->hi
+                                  : addr >= point->lo || addr <= point->hi;
+}
+
+// the first point of one of the given kinds on [addr, addr + len) whose
+// condition holds, or -1
+static int32_t find_point(struct debugger* debugger, const struct cpu* cpu,
+                          uint32_t kinds, uint16_t addr, uint32_t len) {
+    for (uint32_t n = 0; n < debugger->count; ++n) {
+        struct debug_point* point = &debugger->points[n];
+        if (!(kinds & (1U << point->kind))) {
+            continue;
+        }
+        for (uint32_t k = 0; k < len; ++k) {
+            if (covers(point, (addr + k) & cpu->memory_mask) &&
+                debug_check(&point->condition, cpu)) {
+                point->hits++;
+                return (int32_t)n;
+            }
+        }
+    }
+    return -1;
+}
+
+static bool map_any(const uint64_t* map, const struct cpu* cpu,
+                    uint16_t addr, uint32_t len) {
+    for (uint32_t k = 0; k < len; ++k) {
+        if (map_test(map, (addr + k) & cpu->memory_mask)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the point the instruction at pc would hit, or -1
+static int32_t check(struct debugger* debugger, const struct cpu* cpu) {
+    const uint16_t pc = cpu->pc;
+    if (map_test(debugger->break_map, pc)) {
+        const int32_t hit =
+            find_point(debugger, cpu, 1U << DEBUG_BREAK, pc, 1);
+        if (hit >= 0) {
+            return hit;
+        }
+    }
+
+    const uint16_t opcode =
+        (uint16_t)(cpu_peek(cpu, pc) << 8U | cpu_peek(cpu, pc + 1));
+    const uint32_t x = (opcode >> 8U) & 0xFU;
+    uint32_t len = 0;
+    bool write = false;
+    const uint32_t y = (opcode >> 4U) & 0xFU;
+    const bool xo = cpu->mode == CPU_XOCHIP;
+    if ((opcode & 0xF000U) == 0xD000U) {
+        len = opcode & 0xFU;
+        if (len == 0 && cpu->mode != CPU_CHIP8) {
+            len = 32;
+        }
+        // XO-CHIP reads one sprite per selected plane
+        len *= xo ? (uint32_t)__builtin_popcount(cpu->planes) : 1U;
+    } else if (xo && (opcode & 0xF00EU) == 0x5002U) {
+        len = (x > y ? x - y : y - x) + 1;
+        write = !(opcode & 1U);
+    } else if (xo && opcode == 0xF002U) {
+        len = sizeof(cpu->pattern);
+    } else if ((opcode & 0xF0FFU) == 0xF033U) {
+        len = 3;
+        write = true;
+    } else if ((opcode & 0xF0FFU) == 0xF055U) {
+        len = x + 1;
+        write = true;
+    } else if ((opcode & 0xF0FFU) == 0xF065U) {
+        len = x + 1;
+    }
+    if (len == 0) {
+        return -1;
+    }
+
+    const uint64_t* map = write ? debugger->write_map : debugger->read_map;
+    if (!map_any(map, cpu, cpu->i, len)) {
+        return -1;
+    }
+    const uint32_t kinds = 1U << DEBUG_ACCESS |
+                           1U << (write ? DEBUG_WRITE : DEBUG_READ);
+    return find_point(debugger, cpu, kinds, cpu->i, len);
+}
+
+uint32_t debug_run(struct debugger* debugger, struct cpu* cpu,
+                   uint32_t cycles) {
+    debugger->stopped = -1;
+    uint32_t ran = 0;
+    for (; ran < cycles; ++ran) {
+        if (debugger->resume) {
+            debugger->resume = false;
+        } else if (debugger->active) {
+            const int32_t hit = check(debugger, cpu);
+            if (hit >= 0) {
+                debugger->stopped = hit;
+                debugger->resume = true;
+                break;
+            }
+        }
+        cpu_emulate_cycle(cpu);
+    }
+    return ran;
+}
+
+void debug_print_point(const struct debugger* debugger, int32_t id,
+                       FILE* out) {
+    const struct debug_point* point = &debugger->points[id];
+    fprintf(out, "#%d %-8s %04X", id, kind_names[point->kind], point->lo);
+    if (point->hi != point->lo) {
+        fprintf(out, "-%04X", point->hi);
+    }
+    if (point->text[0]) {
+        fprintf(out, " if %s", point->text);
+    }
+    fprintf(out, ", %llu hits\n", (unsigned long long)point->hits);
+}
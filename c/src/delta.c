@@ -0,0 +1,49 @@
+#include "delta.h"
+#include <string.h>
+#include "runs.h"
+
+size_t delta_encode(const struct display* prev, const struct display* next,
+                    uint8_t* out) {
+    struct runs runs = {.out = out};
+
+    const uint8_t header[2] = {
+        (uint8_t)(next->width ^ (prev ? prev->width : 0)),
+        (uint8_t)(next->height ^ (prev ? prev->height : 0)),
+    };
+    runs_bytes(&runs, header, sizeof(header));
+
+    for (uint32_t plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        for (uint32_t y = 0; y < DISPLAY_MAX_HEIGHT; ++y) {
+            const display_row row =
+                prev ? prev->rows[plane][y] ^ next->rows[plane][y]
+                     : next->rows[plane][y];
+            if (!row) {
+                // most rows of most frames are untouched
+                runs_zeros(&runs, DISPLAY_ROW_BYTES);
+                continue;
+            }
+            uint8_t bytes[DISPLAY_ROW_BYTES];
+            display_put_row(bytes, row);
+            runs_bytes(&runs, bytes, sizeof(bytes));
+        }
+    }
+    // trailing zeros are implied by the frame size
+    return runs.size;
+}
+
+bool delta_apply(struct display* display, const uint8_t* in, size_t size) {
+    uint8_t bytes[DELTA_FRAME_BYTES];
+    const size_t n = runs_unpack(in, size, bytes, sizeof(bytes));
+    if (n == SIZE_MAX) {
+        return false;
+    }
+    // trailing zeros are left out, see delta_encode
+    memset(&bytes[n], 0, sizeof(bytes) - n);
+
+    uint8_t image[DISPLAY_IMAGE_BYTES];
+    display_to_image(display, image);
+    for (uint32_t m = 0; m < sizeof(image); ++m) {
+        image[m] ^= bytes[m];
+    }
+    return display_from_image(display, image);
+}
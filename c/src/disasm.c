@@ -0,0 +1,162 @@
+#include "disasm.h"
+#include <stdio.h>
+#include "instr.h"
+
+void disasm_opcode(uint16_t opcode, char* out, size_t size) {
+    union instr instr = {.instr = opcode};
+    const uint32_t x = instr.x;
+    const uint32_t y = instr.y;
+
+    switch (instr.opcode) {
+    case 0x0:
+        switch (instr.nn) {
+        case 0xE0:
+            snprintf(out, size, "cls");
+            return;
+        case 0xEE:
+            snprintf(out, size, "ret");
+            return;
+        }
+        // SUPER-CHIP and XO-CHIP
+        switch (opcode) {
+        case 0x00FB:
+            snprintf(out, size, "scr");
+            return;
+        case 0x00FC:
+            snprintf(out, size, "scl");
+            return;
+        case 0x00FD:
+            snprintf(out, size, "exit");
+            return;
+        case 0x00FE:
+            snprintf(out, size, "low");
+            return;
+        case 0x00FF:
+            snprintf(out, size, "high");
+            return;
+        }
+        if (x == 0 && (y == 0xC || y == 0xD)) {
+            snprintf(out, size, "%s %u", y == 0xC ? "scd" : "scu", instr.n);
+            return;
+        }
+        break;
+    case 0x1:
+        snprintf(out, size, "jp 0x%03X", instr.nnn);
+        return;
+    case 0x2:
+        snprintf(out, size, "call 0x%03X", instr.nnn);
+        return;
+    case 0x3:
+        snprintf(out, size, "se V%X, 0x%02X", x, instr.nn);
+        return;
+    case 0x4:
+        snprintf(out, size, "sne V%X, 0x%02X", x, instr.nn);
+        return;
+    case 0x5:
+        if (instr.n == 2) {
+            snprintf(out, size, "ld [I], V%X-V%X", x, y);
+        } else if (instr.n == 3) {
+            snprintf(out, size, "ld V%X-V%X, [I]", x, y);
+        } else {
+            snprintf(out, size, "se V%X, V%X", x, y);
+        }
+        return;
+    case 0x6:
+        snprintf(out, size, "ld V%X, 0x%02X", x, instr.nn);
+        return;
+    case 0x7:
+        snprintf(out, size, "add V%X, 0x%02X", x, instr.nn);
+        return;
+    case 0x8: {
+        static const char* const alu[16] = {
+            "ld", "or", "and", "xor", "add", "sub", "shr", "subn",
+            NULL, NULL, NULL, NULL, NULL, NULL, "shl", NULL,
+        };
+        if (alu[instr.n]) {
+            snprintf(out, size, "%s V%X, V%X", alu[instr.n], x, y);
+            return;
+        }
+        break;
+    }
+    case 0x9:
+        snprintf(out, size, "sne V%X, V%X", x, y);
+        return;
+    case 0xA:
+        snprintf(out, size, "ld I, 0x%03X", instr.nnn);
+        return;
+    case 0xB:
+        snprintf(out, size, "jp V0, 0x%03X", instr.nnn);
+        return;
+    case 0xC:
+        snprintf(out, size, "rnd V%X, 0x%02X", x, instr.nn);
+        return;
+    case 0xD:
+        snprintf(out, size, "drw V%X, V%X, %u", x, y, instr.n);
+        return;
+    case 0xE:
+        switch (instr.nn) {
+        case 0x9E:
+            snprintf(out, size, "skp V%X", x);
+            return;
+        case 0xA1:
+            snprintf(out, size, "sknp V%X", x);
+            return;
+        }
+        break;
+    case 0xF:
+        if (opcode == 0xF000) {
+            snprintf(out, size, "ld I, long");
+            return;
+        }
+        if (opcode == 0xF002) {
+            snprintf(out, size, "audio");
+            return;
+        }
+        switch (instr.nn) {
+        case 0x01:
+            snprintf(out, size, "plane %u", x);
+            return;
+        case 0x07:
+            snprintf(out, size, "ld V%X, DT", x);
+            return;
+        case 0x0A:
+            snprintf(out, size, "ld V%X, K", x);
+            return;
+        case 0x15:
+            snprintf(out, size, "ld DT, V%X", x);
+            return;
+        case 0x18:
+            snprintf(out, size, "ld ST, V%X", x);
+            return;
+        case 0x1E:
+            snprintf(out, size, "add I, V%X", x);
+            return;
+        case 0x29:
+            snprintf(out, size, "ld F, V%X", x);
+            return;
+        case 0x30:
+            snprintf(out, size, "ld HF, V%X", x);
+            return;
+        case 0x33:
+            snprintf(out, size, "ld B, V%X", x);
+            return;
+        case 0x3A:
+            snprintf(out, size, "pitch V%X", x);
+            return;
+        case 0x55:
+            snprintf(out, size, "ld [I], V%X", x);
+            return;
+        case 0x65:
+            snprintf(out, size, "ld V%X, [I]", x);
+            return;
+        case 0x75:
+            snprintf(out, size, "ld R, V%X", x);
+            return;
+        case 0x85:
+            snprintf(out, size, "ld V%X, R", x);
+            return;
+        }
+        break;
+    }
+    snprintf(out, size, "db 0x%04X", opcode);
+}
@@ -0,0 +1,64 @@
+#include "display.h"
+#include <string.h>
+
+const struct display display_blank[2] = {
+    {.width = SCREEN_WIDTH, .height = SCREEN_HEIGHT},
+    {.width = DISPLAY_MAX_WIDTH, .height = DISPLAY_MAX_HEIGHT},
+};
+
+const uint32_t display_palette[DISPLAY_COLORS] = {
+    0x000000U,
+    0xFFFFFFU,
+    0xFF6600U,
+    0xFFCC00U,
+};
+
+void display_reset(struct display* display, bool hires) {
+    memset(display, 0, sizeof(struct display));
+    display->width = hires ? DISPLAY_MAX_WIDTH : SCREEN_WIDTH;
+    display->height = hires ? DISPLAY_MAX_HEIGHT : SCREEN_HEIGHT;
+}
+
+void display_put_row(uint8_t* out, display_row row) {
+    for (uint32_t n = 0; n < DISPLAY_ROW_BYTES; ++n) {
+        out[n] = (uint8_t)(row >> (DISPLAY_MAX_WIDTH - 8U - n * 8U));
+    }
+}
+
+display_row display_get_row(const uint8_t* in) {
+    display_row row = 0;
+    for (uint32_t n = 0; n < DISPLAY_ROW_BYTES; ++n) {
+        row = (row << 8U) | in[n];
+    }
+    return row;
+}
+
+void display_to_image(const struct display* display, uint8_t* image) {
+    image[0] = (uint8_t)display->width;
+    image[1] = (uint8_t)display->height;
+    uint8_t* out = &image[2];
+    for (uint32_t p = 0; p < DISPLAY_PLANES; ++p) {
+        for (uint32_t y = 0; y < DISPLAY_MAX_HEIGHT; ++y) {
+            display_put_row(out, display->rows[p][y]);
+            out += DISPLAY_ROW_BYTES;
+        }
+    }
+}
+
+bool display_from_image(struct display* display, const uint8_t* image) {
+    const bool lores = image[0] == SCREEN_WIDTH && image[1] == SCREEN_HEIGHT;
+    const bool hires =
+        image[0] == DISPLAY_MAX_WIDTH && image[1] == DISPLAY_MAX_HEIGHT;
+    if (!lores && !hires) {
+        return false;
+    }
+    display_reset(display, hires);
+    const uint8_t* in = &image[2];
+    for (uint32_t p = 0; p < DISPLAY_PLANES; ++p) {
+        for (uint32_t y = 0; y < DISPLAY_MAX_HEIGHT; ++y) {
+            display->rows[p][y] = display_get_row(in);
+            in += DISPLAY_ROW_BYTES;
+        }
+    }
+    return true;
+}
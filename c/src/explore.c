@@ -0,0 +1,419 @@
+#include "explore.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// nodes taken off the frontier per lock acquisition
+#define EXPLORE_BATCH 32
+#define EXPLORE_INPUT_COUNT 17
+
+struct explore_node {
+    struct cpu* cpu;
+    struct explore_node* parent;
+    int32_t score;
+    uint32_t depth;
+    uint8_t input;
+};
+
+struct worker {
+    pthread_t thread;
+    struct explore* explore;
+    struct cpu_pool pool;
+    struct pool nodes;
+    uint64_t frames;
+};
+
+struct explore {
+    const struct explore_config* config;
+
+    // visited set of state hashes, open addressing, 0 marks a free slot
+    uint64_t* visited;
+    size_t visited_mask;
+    uint32_t visited_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    struct explore_node** frontier;
+    size_t head;
+    size_t count;
+    size_t capacity;
+    uint32_t busy;
+    bool stop;
+    bool failed;
+    struct explore_node* found;
+};
+
+static void request_stop(struct explore* ex) {
+    __atomic_store_n(&ex->stop, true, __ATOMIC_RELAXED);
+}
+
+static bool stopped(struct explore* ex) {
+    return __atomic_load_n(&ex->stop, __ATOMIC_RELAXED);
+}
+
+static bool visited_insert(struct explore* ex, uint64_t hash) {
+    hash = hash ? hash : 1;
+    size_t slot = hash & ex->visited_mask;
+    while (true) {
+        uint64_t current = __atomic_load_n(&ex->visited[slot], __ATOMIC_RELAXED);
+        if (current == hash) {
+            return false;
+        }
+        if (current == 0) {
+            if (__atomic_add_fetch(&ex->visited_count, 1, __ATOMIC_RELAXED) >
+                ex->config->max_states) {
+                request_stop(ex);
+                return false;
+            }
+            if (__atomic_compare_exchange_n(&ex->visited[slot], &current, hash,
+                                            false, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                return true;
+            }
+            // lost the race for this slot, look at what landed there
+            __atomic_sub_fetch(&ex->visited_count, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        slot = (slot + 1) & ex->visited_mask;
+    }
+}
+
+// frontier, either a FIFO ring or a max-heap on score. callers hold the lock.
+
+static bool frontier_grow(struct explore* ex) {
+    const size_t capacity = ex->capacity ? ex->capacity * 2 : 1024;
+    struct explore_node** items = malloc(capacity * sizeof(*items));
+    if (!items) {
+        return false;
+    }
+    for (size_t n = 0; n < ex->count; ++n) {
+        items[n] = ex->frontier[(ex->head + n) % ex->capacity];
+    }
+    free(ex->frontier);
+    ex->frontier = items;
+    ex->capacity = capacity;
+    ex->head = 0;
+    return true;
+}
+
+static bool heap_before(const struct explore_node* a,
+                        const struct explore_node* b) {
+    return a->score > b->score || (a->score == b->score && a->depth < b->depth);
+}
+
+static void frontier_push(struct explore* ex, struct explore_node* node) {
+    if (ex->count == ex->capacity && !frontier_grow(ex)) {
+        fputs("Memory error", stderr);
+        ex->failed = true;
+        request_stop(ex);
+        return;
+    }
+    if (!ex->config->score) {
+        ex->frontier[(ex->head + ex->count++) % ex->capacity] = node;
+        return;
+    }
+
+    size_t n = ex->count++;
+    while (n > 0) {
+        const size_t parent = (n - 1) / 2;
+        if (!heap_before(node, ex->frontier[parent])) {
+            break;
+        }
+        ex->frontier[n] = ex->frontier[parent];
+        n = parent;
+    }
+    ex->frontier[n] = node;
+}
+
+static struct explore_node* frontier_pop(struct explore* ex) {
+    if (!ex->config->score) {
+        struct explore_node* node = ex->frontier[ex->head];
+        ex->head = (ex->head + 1) % ex->capacity;
+        ex->count--;
+        return node;
+    }
+
+    struct explore_node* top = ex->frontier[0];
+    struct explore_node* last = ex->frontier[--ex->count];
+    size_t n = 0;
+    while (true) {
+        size_t child = n * 2 + 1;
+        if (child >= ex->count) {
+            break;
+        }
+        if (child + 1 < ex->count &&
+            heap_before(ex->frontier[child + 1], ex->frontier[child])) {
+            child++;
+        }
+        if (!heap_before(ex->frontier[child], last)) {
+            break;
+        }
+        ex->frontier[n] = ex->frontier[child];
+        n = child;
+    }
+    ex->frontier[n] = last;
+    return top;
+}
+
+// blocks until work is available, returns 0 once the search is over
+static size_t take_batch(struct explore* ex, struct explore_node** batch) {
+    pthread_mutex_lock(&ex->lock);
+    while (ex->count == 0 && ex->busy > 0 && !stopped(ex)) {
+        pthread_cond_wait(&ex->ready, &ex->lock);
+    }
+    if (stopped(ex) || ex->count == 0) {
+        request_stop(ex);
+        pthread_cond_broadcast(&ex->ready);
+        pthread_mutex_unlock(&ex->lock);
+        return 0;
+    }
+
+    size_t n = 0;
+    while (n < EXPLORE_BATCH && ex->count > 0) {
+        batch[n++] = frontier_pop(ex);
+    }
+    ex->busy++;
+    pthread_mutex_unlock(&ex->lock);
+    return n;
+}
+
+static void finish_batch(struct explore* ex, struct explore_node** children,
+                         size_t count) {
+    pthread_mutex_lock(&ex->lock);
+    for (size_t n = 0; n < count; ++n) {
+        frontier_push(ex, children[n]);
+    }
+    ex->busy--;
+    pthread_cond_broadcast(&ex->ready);
+    pthread_mutex_unlock(&ex->lock);
+}
+
+static struct explore_node* node_create(struct worker* w, struct cpu* cpu,
+                                        struct explore_node* parent,
+                                        uint8_t input) {
+    struct explore_node* node = pool_alloc(&w->nodes);
+    if (!node) {
+        return NULL;
+    }
+    const struct explore_config* config = w->explore->config;
+    *node = (struct explore_node){
+        .cpu = cpu,
+        .parent = parent,
+        .score = config->score ? config->score(cpu, config->user) : 0,
+        .depth = parent ? parent->depth + 1 : 0,
+        .input = input,
+    };
+    return node;
+}
+
+static void release_cpu(struct worker* w, struct explore_node* node) {
+    if (!node->cpu) {
+        return;
+    }
+    // the instance may come from another worker, free it into our own pool
+    node->cpu->pool = &w->pool;
+    cpu_destroy(node->cpu);
+    node->cpu = NULL;
+}
+
+static size_t expand(struct worker* w, struct explore_node* node,
+                     struct explore_node** children) {
+    struct explore* ex = w->explore;
+    const struct explore_config* config = ex->config;
+    size_t produced = 0;
+
+    for (uint8_t input = 0; input < EXPLORE_INPUT_COUNT; ++input) {
+        if (!(config->inputs & (1U << input))) {
+            continue;
+        }
+        if (stopped(ex)) {
+            break;
+        }
+
+        struct cpu* cpu = cpu_fork(node->cpu, &w->pool);
+        if (!cpu) {
+            fputs("Memory error", stderr);
+            pthread_mutex_lock(&ex->lock);
+            ex->failed = true;
+            pthread_mutex_unlock(&ex->lock);
+            request_stop(ex);
+            break;
+        }
+        cpu->key = input == EXPLORE_NO_KEY ? 0 : 1U << input;
+        for (uint32_t n = 0; n < config->cycles_per_frame; ++n) {
+            cpu_emulate_cycle(cpu);
+        }
+        w->frames++;
+
+        if (!visited_insert(ex, cpu_state_hash(cpu))) {
+            cpu_destroy(cpu);
+            continue;
+        }
+
+        struct explore_node* child = node_create(w, cpu, node, input);
+        if (!child) {
+            cpu_destroy(cpu);
+            continue;
+        }
+
+        if (config->goal && config->goal(cpu, config->user)) {
+            pthread_mutex_lock(&ex->lock);
+            if (!ex->found) {
+                ex->found = child;
+            }
+            request_stop(ex);
+            pthread_mutex_unlock(&ex->lock);
+            release_cpu(w, child);
+            break;
+        }
+
+        if (child->depth >= config->max_depth) {
+            release_cpu(w, child);
+            continue;
+        }
+        children[produced++] = child;
+    }
+
+    release_cpu(w, node);
+    return produced;
+}
+
+static void* worker_main(void* arg) {
+    struct worker* w = arg;
+    struct explore_node* batch[EXPLORE_BATCH];
+    struct explore_node* children[EXPLORE_BATCH * EXPLORE_INPUT_COUNT];
+
+    size_t count;
+    while ((count = take_batch(w->explore, batch)) != 0) {
+        size_t produced = 0;
+        for (size_t n = 0; n < count; ++n) {
+            produced += expand(w, batch[n], &children[produced]);
+        }
+        finish_batch(w->explore, children, produced);
+    }
+    return NULL;
+}
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) +
+           (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int32_t explore_run(struct cpu* root, const struct explore_config* config,
+                    struct explore_result* result) {
+    if (!root || !config || !result || config->threads == 0) {
+        return 1;
+    }
+    *result = (struct explore_result){0};
+    // a frame is one timer tick, whatever the root was clocked at
+    cpu_set_clock(root, config->cycles_per_frame * 60);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    size_t slots = 1024;
+    while (slots < (size_t)config->max_states * 2) {
+        slots *= 2;
+    }
+
+    struct explore ex = {
+        .config = config,
+        .visited = calloc(slots, sizeof(uint64_t)),
+        .visited_mask = slots - 1,
+    };
+    struct worker* workers = calloc(config->threads, sizeof(struct worker));
+    if (!ex.visited || !workers) {
+        fputs("Memory error", stderr);
+        free(ex.visited);
+        free(workers);
+        return 1;
+    }
+    pthread_mutex_init(&ex.lock, NULL);
+    pthread_cond_init(&ex.ready, NULL);
+
+    uint32_t ready = 0;
+    for (; ready < config->threads; ++ready) {
+        struct worker* w = &workers[ready];
+        w->explore = &ex;
+        if (cpu_pool_init(&w->pool, 256) != 0) {
+            break;
+        }
+        if (pool_init(&w->nodes, sizeof(struct explore_node),
+                      _Alignof(struct explore_node), 4096) != 0) {
+            cpu_pool_destroy(&w->pool);
+            break;
+        }
+    }
+
+    int32_t status = 1;
+    struct cpu* first = ready == config->threads
+                            ? cpu_fork(root, &workers[0].pool)
+                            : NULL;
+    struct explore_node* origin =
+        first ? node_create(&workers[0], first, NULL, EXPLORE_NO_KEY) : NULL;
+    if (origin) {
+        visited_insert(&ex, cpu_state_hash(first));
+        frontier_push(&ex, origin);
+
+        uint32_t started = 0;
+        for (; started < config->threads; ++started) {
+            if (pthread_create(&workers[started].thread, NULL, worker_main,
+                               &workers[started]) != 0) {
+                pthread_mutex_lock(&ex.lock);
+                request_stop(&ex);
+                ex.failed = true;
+                pthread_cond_broadcast(&ex.ready);
+                pthread_mutex_unlock(&ex.lock);
+                break;
+            }
+        }
+        for (uint32_t n = 0; n < started; ++n) {
+            pthread_join(workers[n].thread, NULL);
+        }
+        status = ex.failed ? 1 : 0;
+    }
+
+    if (ex.found) {
+        result->found = true;
+        result->depth = ex.found->depth;
+        result->inputs = malloc(result->depth ? result->depth : 1);
+        if (result->inputs) {
+            for (struct explore_node* node = ex.found; node->parent;
+                 node = node->parent) {
+                result->inputs[node->depth - 1] = node->input;
+            }
+        } else {
+            status = 1;
+        }
+    }
+    for (uint32_t n = 0; n < ready; ++n) {
+        result->frames += workers[n].frames;
+    }
+    result->states = ex.visited_count < config->max_states
+                         ? ex.visited_count
+                         : config->max_states;
+    result->seconds = seconds_since(&start);
+
+    // return root's pages before tearing down the pools they migrated into
+    for (size_t n = 0; n < ex.count; ++n) {
+        release_cpu(&workers[0], ex.frontier[(ex.head + n) % ex.capacity]);
+    }
+    if (!origin && first) {
+        cpu_destroy(first);
+    }
+    for (uint32_t n = 0; n < ready; ++n) {
+        pool_destroy(&workers[n].nodes);
+        cpu_pool_destroy(&workers[n].pool);
+    }
+
+    pthread_cond_destroy(&ex.ready);
+    pthread_mutex_destroy(&ex.lock);
+    free(ex.frontier);
+    free(ex.visited);
+    free(workers);
+    return status;
+}
@@ -0,0 +1,227 @@
+#include "export.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct export {
+    uint8_t* data;
+    size_t size;
+    struct export_header* header;
+    struct export_slot* slots;
+    // set on the creating side only
+    bool owner;
+    // remote key state last merged into each instance
+    uint16_t* last_input;
+    char name[256];
+};
+
+static bool set_name(struct export* export, const char* name) {
+    const int32_t len = snprintf(export->name, sizeof(export->name), "%s%s",
+                                 name[0] == '/' ? "" : "/", name);
+    return len > 1 && (size_t)len < sizeof(export->name) &&
+           !strchr(&export->name[1], '/');
+}
+
+static bool map(struct export* export, int fd, size_t size) {
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fputs("File error", stderr);
+        return false;
+    }
+    export->data = data;
+    export->size = size;
+    export->header = data;
+    export->slots = (struct export_slot*)&export->data[sizeof(
+        struct export_header)];
+    return true;
+}
+
+struct export* export_create(const char* name, uint32_t count) {
+    if (count == 0 || count > EXPORT_MAX_SLOTS) {
+        printf("Error: an export holds 1 to %u instances", EXPORT_MAX_SLOTS);
+        return NULL;
+    }
+    struct export* export = calloc(1, sizeof(struct export));
+    uint16_t* last_input = calloc(count, sizeof(uint16_t));
+    if (!export || !last_input) {
+        fputs("Memory error", stderr);
+        free(export);
+        free(last_input);
+        return NULL;
+    }
+    if (!set_name(export, name)) {
+        printf("Error: invalid export name %s", name);
+        free(export);
+        free(last_input);
+        return NULL;
+    }
+
+    const size_t size = sizeof(struct export_header) +
+                        (size_t)count * sizeof(struct export_slot);
+    const int fd =
+        shm_open(export->name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        fputs("File error", stderr);
+        free(export);
+        free(last_input);
+        return NULL;
+    }
+    // the segment starts out zeroed, i.e. every slot is unpublished
+    if (ftruncate(fd, size) != 0) {
+        fputs("File error", stderr);
+        close(fd);
+        shm_unlink(export->name);
+        free(export);
+        free(last_input);
+        return NULL;
+    }
+    if (!map(export, fd, size)) {
+        shm_unlink(export->name);
+        free(export);
+        free(last_input);
+        return NULL;
+    }
+    export->owner = true;
+    export->last_input = last_input;
+
+    export->header->version = EXPORT_VERSION;
+    export->header->slots = count;
+    export->header->slot_size = sizeof(struct export_slot);
+    // readers check the magic last, so they never see a half made header
+    __atomic_store_n(&export->header->magic, EXPORT_MAGIC, __ATOMIC_RELEASE);
+    return export;
+}
+
+struct export* export_open(const char* name) {
+    struct export* export = calloc(1, sizeof(struct export));
+    if (!export) {
+        fputs("Memory error", stderr);
+        return NULL;
+    }
+    if (!set_name(export, name)) {
+        printf("Error: invalid export name %s", name);
+        free(export);
+        return NULL;
+    }
+
+    const int fd = shm_open(export->name, O_RDWR | O_CLOEXEC, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fputs("File error", stderr);
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(export);
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(struct export_header)) {
+        printf("Error: not a chip8 export");
+        close(fd);
+        free(export);
+        return NULL;
+    }
+    if (!map(export, fd, st.st_size)) {
+        free(export);
+        return NULL;
+    }
+
+    const struct export_header* header = export->header;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != EXPORT_MAGIC ||
+        header->version != EXPORT_VERSION ||
+        header->slot_size != sizeof(struct export_slot) ||
+        (export->size - sizeof(struct export_header)) /
+                sizeof(struct export_slot) <
+            header->slots) {
+        printf("Error: not a chip8 export");
+        export_destroy(export);
+        return NULL;
+    }
+    return export;
+}
+
+void export_destroy(struct export* export) {
+    if (!export) {
+        return;
+    }
+    munmap(export->data, export->size);
+    if (export->owner) {
+        shm_unlink(export->name);
+    }
+    free(export->last_input);
+    free(export);
+}
+
+uint32_t export_slots(const struct export* export) {
+    return export->header->slots;
+}
+
+void export_publish(struct export* export, uint32_t slot,
+                    const struct cpu* cpu, uint64_t frame) {
+    struct export_slot* s = &export->slots[slot];
+    // only this side writes seq, a plain read is fine
+    const uint32_t seq = s->seq;
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    struct export_state* state = &s->state;
+    state->frame = frame;
+    state->display = *cpu->display;
+    memcpy(state->v, cpu->v, sizeof(state->v));
+    memcpy(state->stack, cpu->stack, sizeof(state->stack));
+    state->i = cpu->i;
+    state->pc = cpu->pc;
+    state->key = cpu->key;
+    state->sp = cpu->sp;
+    state->dt = cpu_dt(cpu);
+    state->st = cpu_st(cpu);
+    state->mode = cpu->mode;
+
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void export_poll_input(struct export* export, uint32_t slot,
+                       struct cpu* cpu) {
+    const uint32_t input =
+        __atomic_load_n(&export->slots[slot].input, __ATOMIC_ACQUIRE);
+    if (!(input & EXPORT_INPUT_ACTIVE)) {
+        return;
+    }
+    const uint16_t keys = (uint16_t)input;
+    const uint16_t changed = keys ^ export->last_input[slot];
+    cpu->key = (cpu->key & ~changed) | (keys & changed);
+    export->last_input[slot] = keys;
+}
+
+bool export_read(const struct export* export, uint32_t slot,
+                 struct export_state* out) {
+    if (slot >= export->header->slots) {
+        return false;
+    }
+    const struct export_slot* s = &export->slots[slot];
+    while (true) {
+        const uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1U) {
+            // mid publish, let the emulator finish
+            sched_yield();
+            continue;
+        }
+        memcpy(out, &s->state, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq) {
+            return true;
+        }
+    }
+}
+
+void export_send_input(struct export* export, uint32_t slot, uint16_t keys) {
+    if (slot < export->header->slots) {
+        __atomic_store_n(&export->slots[slot].input,
+                         EXPORT_INPUT_ACTIVE | keys, __ATOMIC_RELEASE);
+    }
+}
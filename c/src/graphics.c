@@ -1,7 +1,8 @@
 #include "graphics.h"
 #include <SDL2/SDL.h>
 
-static const int32_t display_scale = 10;
+// window pixels per hires pixel
+static const int32_t display_scale = 5;
 
 struct graphics* graphics_create(void) {
     struct graphics* graphics = malloc(sizeof(struct graphics));
@@ -20,9 +21,9 @@ int32_t graphics_init(struct graphics* graphics) {
         SDL_CreateWindow("chip8", // window title
                          SDL_WINDOWPOS_UNDEFINED, // initial x position
                          SDL_WINDOWPOS_UNDEFINED, // initial y position
-                         SCREEN_WIDTH * display_scale,  // width, in pixels
-                         SCREEN_HEIGHT * display_scale, // height, in pixels
-                         SDL_WINDOW_SHOWN               // flags
+                         DISPLAY_MAX_WIDTH * display_scale,  // width
+                         DISPLAY_MAX_HEIGHT * display_scale, // height
+                         SDL_WINDOW_SHOWN                    // flags
         );
 
     if (!window) {
@@ -40,46 +41,55 @@ int32_t graphics_init(struct graphics* graphics) {
         return 1;
     }
 
+    SDL_Texture* texture = SDL_CreateTexture(
+        renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+        DISPLAY_MAX_WIDTH, DISPLAY_MAX_HEIGHT);
+    if (!texture) {
+        printf("SDL could not create texture! SDL_Error: %s\n",
+               SDL_GetError());
+
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        return 1;
+    }
+
     *graphics = (struct graphics){
         .window = window,
         .renderer = renderer,
-        .vram = {0},
-        .draw_flag = false,
+        .texture = texture,
     };
-
-    graphics->draw_flag = true;
     return 0;
 }
 
-void graphics_draw(struct graphics* graphics) {
-    if (!graphics->draw_flag) {
+// one texture upload and copy per frame instead of a rect per pixel
+void graphics_draw(struct graphics* graphics, const struct display* display) {
+    void* pixels = NULL;
+    int pitch = 0;
+    if (SDL_LockTexture(graphics->texture, NULL, &pixels, &pitch) != 0) {
         return;
     }
-
-    SDL_SetRenderDrawColor(graphics->renderer, 0, 0, 0, 0xFF);
-    SDL_RenderClear(graphics->renderer);
-
-    for (int32_t y = 0; y < SCREEN_HEIGHT; y++) {
-        for (int32_t x = 0; x < SCREEN_WIDTH; x++) {
-            int32_t addr = y * SCREEN_WIDTH + x;
-            if (graphics->vram[addr]) {
-                SDL_SetRenderDrawColor(graphics->renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-                SDL_Rect block = {x * display_scale, y * display_scale,
-                                  display_scale, display_scale};
-                SDL_RenderDrawRect(graphics->renderer, &block);
-                SDL_RenderFillRect(graphics->renderer, &block);
-            }
+    for (uint32_t y = 0; y < DISPLAY_MAX_HEIGHT; y++) {
+        uint32_t* row = (uint32_t*)((uint8_t*)pixels + y * pitch);
+        for (uint32_t x = 0; x < DISPLAY_MAX_WIDTH; x++) {
+            row[x] = 0xFF000000U |
+                     display_palette[display_canvas_pixel(display, x, y)];
         }
     }
+    SDL_UnlockTexture(graphics->texture);
+
+    SDL_RenderClear(graphics->renderer);
+    SDL_RenderCopy(graphics->renderer, graphics->texture, NULL, NULL);
+}
 
+void graphics_present(struct graphics* graphics) {
     SDL_RenderPresent(graphics->renderer);
-    graphics->draw_flag = false;
 }
 
 void graphics_destroy(struct graphics* graphics) {
     if (!graphics) {
         return;
     }
+    SDL_DestroyTexture(graphics->texture);
     SDL_DestroyRenderer(graphics->renderer);
     SDL_DestroyWindow(graphics->window);
     free(graphics);
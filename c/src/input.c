@@ -0,0 +1,71 @@
+#include "input.h"
+
+void cpu_handle_sdl_key_event(struct cpu* cpu, SDL_Event event,
+                              struct latency* latency) {
+    bool key_value = false;
+    if (event.type == SDL_KEYDOWN) {
+        key_value = true;
+    } else if (event.type != SDL_KEYUP) {
+        printf("Unknown input event: %d", event.type);
+        return;
+    }
+
+    uint8_t keycode = 0;
+    switch (event.key.keysym.sym) {
+    case SDLK_1:
+        keycode = 0x1;
+        break;
+    case SDLK_2:
+        keycode = 0x2;
+        break;
+    case SDLK_3:
+        keycode = 0x3;
+        break;
+    case SDLK_4:
+        keycode = 0xC;
+        break;
+    case SDLK_q:
+        keycode = 0x4;
+        break;
+    case SDLK_w:
+        keycode = 0x5;
+        break;
+    case SDLK_e:
+        keycode = 0x6;
+        break;
+    case SDLK_r:
+        keycode = 0xD;
+        break;
+    case SDLK_a:
+        keycode = 0x7;
+        break;
+    case SDLK_s:
+        keycode = 0x8;
+        break;
+    case SDLK_d:
+        keycode = 0x9;
+        break;
+    case SDLK_f:
+        keycode = 0xE;
+        break;
+    case SDLK_z:
+        keycode = 0xA;
+        break;
+    case SDLK_x:
+        keycode = 0x0;
+        break;
+    case SDLK_c:
+        keycode = 0xB;
+        break;
+    case SDLK_v:
+        keycode = 0xF;
+        break;
+    default:
+        return;
+    }
+    // held keys repeat, but only the first press changes anything
+    if (latency && !event.key.repeat) {
+        latency_key(latency, keycode, key_value);
+    }
+    cpu_set_key(cpu, keycode, key_value);
+}
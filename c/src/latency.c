@@ -0,0 +1,264 @@
+#include "latency.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+// frames between refreshes of the stats file
+#define LATENCY_STATS_FRAMES 60
+
+enum stage {
+    STAGE_OBSERVE,
+    STAGE_CHANGE,
+    STAGE_PRESENT,
+};
+
+struct event {
+    uint64_t start;
+    uint8_t key;
+    bool pressed;
+    uint8_t stage;
+    // cpu->display_writes when the key was read, to catch the first change
+    // after it
+    uint32_t display_writes;
+};
+
+struct latency {
+    char* stats_filename;
+    uint64_t frames;
+
+    struct event pending[LATENCY_MAX_PENDING];
+    uint32_t pending_count;
+    // events waiting on an instruction or a display change
+    uint32_t waiting;
+
+    uint64_t events;
+    uint64_t dropped;
+    uint64_t timed_out;
+
+    struct histogram metrics[LATENCY_METRICS];
+};
+
+static const char* const metric_names[LATENCY_METRICS] = {
+    [LATENCY_KEY_OBSERVE] = "key to observe",
+    [LATENCY_KEY_CHANGE] = "key to change",
+    [LATENCY_KEY_PRESENT] = "key to present",
+    [LATENCY_FRAME_EMULATE] = "frame emulate",
+    [LATENCY_FRAME_RENDER] = "frame render",
+    [LATENCY_FRAME_PRESENT] = "frame present",
+};
+
+static uint32_t bucket_index(uint64_t value) {
+    if (value < (1U << HISTOGRAM_SUB_BITS)) {
+        return (uint32_t)value;
+    }
+    const uint32_t shift = 63U - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    const uint32_t sub = (value >> shift) & ((1U << HISTOGRAM_SUB_BITS) - 1);
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+static uint64_t bucket_lower(uint32_t index) {
+    if (index < (1U << HISTOGRAM_SUB_BITS)) {
+        return index;
+    }
+    const uint32_t shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+    const uint64_t sub = index & ((1U << HISTOGRAM_SUB_BITS) - 1);
+    return (sub + (1U << HISTOGRAM_SUB_BITS)) << shift;
+}
+
+void histogram_record(struct histogram* histogram, uint64_t value) {
+    if (histogram->count == 0 || value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    histogram->count++;
+    histogram->sum += value;
+    histogram->buckets[bucket_index(value)]++;
+}
+
+uint64_t histogram_percentile(const struct histogram* histogram,
+                              double percentile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(percentile / 100.0 *
+                                 (double)histogram->count + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (uint32_t n = 0; n < HISTOGRAM_BUCKETS; ++n) {
+        seen += histogram->buckets[n];
+        if (seen >= target) {
+            const uint64_t lower = bucket_lower(n);
+            return lower > histogram->min ? lower : histogram->min;
+        }
+    }
+    return histogram->max;
+}
+
+uint64_t latency_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NANOSECONDS_PER_SECOND +
+           (uint64_t)ts.tv_nsec;
+}
+
+struct latency* latency_create(const char* stats_filename) {
+    struct latency* latency = calloc(1, sizeof(struct latency));
+    if (!latency) {
+        fputs("Memory error", stderr);
+        return NULL;
+    }
+    if (stats_filename) {
+        latency->stats_filename = strdup(stats_filename);
+        if (!latency->stats_filename) {
+            fputs("Memory error", stderr);
+            free(latency);
+            return NULL;
+        }
+    }
+    return latency;
+}
+
+static void remove_event(struct latency* latency, uint32_t n) {
+    latency->pending[n] = latency->pending[--latency->pending_count];
+}
+
+void latency_key(struct latency* latency, uint8_t key, bool pressed) {
+    latency->events++;
+    if (latency->pending_count == LATENCY_MAX_PENDING) {
+        latency->dropped++;
+        return;
+    }
+    struct event* event = &latency->pending[latency->pending_count++];
+    event->start = latency_now();
+    event->key = key & 0xFU;
+    event->pressed = pressed;
+    event->stage = STAGE_OBSERVE;
+    latency->waiting++;
+}
+
+void latency_cycle(struct latency* latency, struct cpu* cpu) {
+    // keys read before an event must not count for it
+    const uint16_t read = cpu->key_read;
+    cpu->key_read = 0;
+    if (latency->waiting == 0) {
+        return;
+    }
+
+    uint64_t now = 0;
+    for (uint32_t n = 0; n < latency->pending_count; ++n) {
+        struct event* event = &latency->pending[n];
+        if (event->stage == STAGE_OBSERVE && (read & (1U << event->key))) {
+            now = now ? now : latency_now();
+            histogram_record(&latency->metrics[LATENCY_KEY_OBSERVE],
+                             now - event->start);
+            event->display_writes = cpu->display_writes;
+            event->stage = STAGE_CHANGE;
+        } else if (event->stage == STAGE_CHANGE &&
+                   event->display_writes != cpu->display_writes) {
+            now = now ? now : latency_now();
+            histogram_record(&latency->metrics[LATENCY_KEY_CHANGE],
+                             now - event->start);
+            event->stage = STAGE_PRESENT;
+            latency->waiting--;
+        }
+    }
+}
+
+void latency_present(struct latency* latency) {
+    uint64_t now = 0;
+    for (uint32_t n = 0; n < latency->pending_count;) {
+        struct event* event = &latency->pending[n];
+        if (event->stage != STAGE_PRESENT) {
+            n++;
+            continue;
+        }
+        now = now ? now : latency_now();
+        histogram_record(&latency->metrics[LATENCY_KEY_PRESENT],
+                         now - event->start);
+        remove_event(latency, n);
+    }
+}
+
+void latency_record(struct latency* latency, enum latency_metric metric,
+                    uint64_t ns) {
+    histogram_record(&latency->metrics[metric], ns);
+}
+
+static void write_stats(const struct latency* latency) {
+    // written aside and renamed so readers never see a partial file
+    char temp[4096];
+    if (snprintf(temp, sizeof(temp), "%s.tmp", latency->stats_filename) >=
+        (int)sizeof(temp)) {
+        return;
+    }
+    FILE* file = fopen(temp, "we");
+    if (!file) {
+        return;
+    }
+    latency_print(latency, file);
+    if (fclose(file) == 0) {
+        rename(temp, latency->stats_filename);
+    }
+}
+
+void latency_frame(struct latency* latency) {
+    const uint64_t now = latency_now();
+    for (uint32_t n = 0; n < latency->pending_count;) {
+        struct event* event = &latency->pending[n];
+        if (now - event->start < LATENCY_TIMEOUT_NS) {
+            n++;
+            continue;
+        }
+        if (event->stage != STAGE_PRESENT) {
+            latency->waiting--;
+        }
+        latency->timed_out++;
+        remove_event(latency, n);
+    }
+
+    latency->frames++;
+    if (latency->stats_filename &&
+        latency->frames % LATENCY_STATS_FRAMES == 0) {
+        write_stats(latency);
+    }
+}
+
+void latency_print(const struct latency* latency, FILE* file) {
+    fprintf(file,
+            "%llu key events, %llu timed out, %llu dropped, %llu frames\n",
+            (unsigned long long)latency->events,
+            (unsigned long long)latency->timed_out,
+            (unsigned long long)latency->dropped,
+            (unsigned long long)latency->frames);
+    fprintf(file, "%-16s %8s %9s %9s %9s %9s %9s %9s\n", "ms", "count",
+            "p50", "p90", "p99", "p99.9", "max", "mean");
+    for (uint32_t n = 0; n < LATENCY_METRICS; ++n) {
+        const struct histogram* h = &latency->metrics[n];
+        fprintf(file,
+                "%-16s %8llu %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+                metric_names[n], (unsigned long long)h->count,
+                (double)histogram_percentile(h, 50.0) * 1e-6,
+                (double)histogram_percentile(h, 90.0) * 1e-6,
+                (double)histogram_percentile(h, 99.0) * 1e-6,
+                (double)histogram_percentile(h, 99.9) * 1e-6,
+                (double)h->max * 1e-6,
+                h->count ? (double)h->sum / (double)h->count * 1e-6 : 0.0);
+    }
+}
+
+void latency_destroy(struct latency* latency) {
+    if (!latency) {
+        return;
+    }
+    latency_print(latency, stdout);
+    if (latency->stats_filename) {
+        write_stats(latency);
+    }
+    free(latency->stats_filename);
+    free(latency);
+}
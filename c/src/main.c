@@ -1,13 +1,67 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_events.h>
 #include <SDL2/SDL_timer.h>
+#include <string.h>
+#include "audio.h"
 #include "cpu.h"
+#include "export.h"
+#include "graphics.h"
+#include "input.h"
+#include "latency.h"
+#include "pack.h"
+#include "record.h"
+#include "stream.h"
 
 #define MILLISECONDS_PER_FRAME 1000.0f / 60.0f
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        printf("please provide a path to a chip8 application\n\n");
+    const char* filename = NULL;
+    const char* trace_filename = NULL;
+    const char* pack_filename = NULL;
+    const char* export_name = NULL;
+    const char* stream_path = NULL;
+    const char* record_filename = NULL;
+    const char* latency_filename = NULL;
+    const char* mode_name = NULL;
+    bool trace_compress = true;
+
+    for (int32_t n = 1; n < argc; ++n) {
+        if (strcmp(argv[n], "--trace") == 0 && n + 1 < argc) {
+            trace_filename = argv[++n];
+        } else if (strcmp(argv[n], "--trace-raw") == 0) {
+            trace_compress = false;
+        } else if (strcmp(argv[n], "--pack") == 0 && n + 1 < argc) {
+            pack_filename = argv[++n];
+        } else if (strcmp(argv[n], "--export") == 0 && n + 1 < argc) {
+            export_name = argv[++n];
+        } else if (strcmp(argv[n], "--stream") == 0 && n + 1 < argc) {
+            stream_path = argv[++n];
+        } else if (strcmp(argv[n], "--record") == 0 && n + 1 < argc) {
+            record_filename = argv[++n];
+        } else if (strcmp(argv[n], "--latency") == 0 && n + 1 < argc) {
+            latency_filename = argv[++n];
+        } else if (strcmp(argv[n], "--mode") == 0 && n + 1 < argc) {
+            mode_name = argv[++n];
+        } else {
+            filename = argv[n];
+        }
+    }
+
+    if (!filename ||
+        (mode_name && cpu_mode_from_name(mode_name) == CPU_MODES)) {
+        printf("please provide a path to a chip8 application\n"
+               "usage: chip8 [--trace FILE [--trace-raw]] [--pack FILE]\n"
+               "             [--export NAME] [--stream SOCKET]\n"
+               "             [--record FILE] [--latency FILE]\n"
+               "             [--mode chip8|schip|xochip] rom\n"
+               "with --pack, rom is the name of a ROM in the pack\n"
+               "with --export, state is shared as /NAME, see chip8-peek\n"
+               "with --stream, the screen is served on SOCKET, see "
+               "chip8-watch\n"
+               "with --record, frames and sound go to FILE, see chip8-video\n"
+               "with --latency, input latency and frame times are kept in "
+               "FILE\n"
+               "the mode defaults to the pack's profile, or chip8\n\n");
         return EXIT_FAILURE;
     }
 
@@ -16,31 +70,113 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
-    struct cpu* cpu = cpu_create();
+    // every handle starts out NULL and the destroy functions take NULL, so
+    // any failure can jump straight to cleanup
+    int status = EXIT_FAILURE;
+    struct rom* rom = NULL;
+    struct pack* pack = NULL;
+    struct cpu_pool pool = {0};
+    struct cpu* cpu = NULL;
+    struct trace* trace = NULL;
+    struct export* export = NULL;
+    struct stream* stream = NULL;
+    struct record* record = NULL;
+    struct latency* latency = NULL;
+    struct graphics* graphics = NULL;
+    struct audio* audio = NULL;
+
+    // instructions per second, packs may carry a per ROM rate
+    uint32_t cycles_per_second = 1000;
+    uint8_t mode = CPU_CHIP8;
+    struct pack_rom packed;
+    if (pack_filename) {
+        pack = pack_open(pack_filename);
+        if (!pack || !pack_find(pack, filename, &packed)) {
+            printf("Failed to load chip8 application");
+            goto cleanup;
+        }
+        if (packed.ipf) {
+            cycles_per_second = packed.ipf * 60U;
+        }
+        if (packed.profile < CPU_MODES) {
+            mode = packed.profile;
+        }
+    } else {
+        rom = rom_load(filename);
+        if (!rom) {
+            printf("Failed to load chip8 application");
+            goto cleanup;
+        }
+    }
+
+    if (cpu_pool_init(&pool, 1) != 0) {
+        goto cleanup;
+    }
+    cpu = cpu_create(&pool);
     if (!cpu) {
-        return EXIT_FAILURE;
+        goto cleanup;
+    }
+    cpu_set_mode(cpu, mode_name ? cpu_mode_from_name(mode_name) : mode);
+    if (!cpu_load_application(cpu, pack ? &packed.rom : rom)) {
+        goto cleanup;
     }
+    cpu_set_clock(cpu, cycles_per_second);
 
-    if (!cpu_load_application(cpu, argv[1])) {
-        printf("Failed to load chip8 application");
-        cpu_destroy(cpu);
-        return EXIT_FAILURE;
+    if (trace_filename) {
+        trace = trace_create(trace_filename, trace_compress);
+        cpu->trace = trace ? trace_attach(trace) : NULL;
+        if (!cpu->trace) {
+            goto cleanup;
+        }
+    }
+    if (export_name) {
+        export = export_create(export_name, 1);
+        if (!export) {
+            goto cleanup;
+        }
+    }
+    if (stream_path) {
+        stream = stream_create(stream_path, 1);
+        if (!stream) {
+            goto cleanup;
+        }
+    }
+    if (record_filename) {
+        record = record_create(record_filename, false);
+        if (!record) {
+            goto cleanup;
+        }
+    }
+    if (latency_filename) {
+        latency = latency_create(latency_filename);
+        if (!latency) {
+            goto cleanup;
+        }
+    }
+    graphics = graphics_create();
+    audio = audio_create();
+    if (!graphics || !audio) {
+        goto cleanup;
     }
 
     uint32_t last_ticks = SDL_GetTicks();
     uint32_t last_delta = 0;
     uint32_t cycle_delta = 0;
     float_t frame_delta = 0;
+    uint64_t frame = 0;
+    uint64_t emulate_ns = 0;
+    uint64_t sound_end = 0;
 
     while (true) {
         SDL_Event sdlEvent;
         while (SDL_PollEvent(&sdlEvent) != 0) {
             switch (sdlEvent.type) {
             case SDL_QUIT:
-                goto QUIT;
+                status = EXIT_SUCCESS;
+                goto cleanup;
             case SDL_KEYDOWN:
             case SDL_KEYUP: {
-                cpu_handle_sdl_key_event(cpu, sdlEvent);
+                cpu_handle_sdl_key_event(cpu, sdlEvent, latency);
                 break;
             }
             }
@@ -48,24 +184,92 @@ int main(int argc, char* argv[]) {
 
         last_delta = SDL_GetTicks() - last_ticks;
         last_ticks = SDL_GetTicks();
-        cycle_delta += last_delta;
+        cycle_delta += last_delta * cycles_per_second;
         frame_delta += (float_t)last_delta;
 
-        // 10 cycles per second
-        while (cycle_delta >= 1) {
+        // cycle_delta is in thousandths of a cycle
+        const uint64_t emulate_start = latency ? latency_now() : 0;
+        while (cycle_delta >= 1000) {
             cpu_emulate_cycle(cpu);
-            cycle_delta -= 1;
+            if (latency) {
+                latency_cycle(latency, cpu);
+            }
+            cycle_delta -= 1000;
+        }
+        if (latency) {
+            emulate_ns += latency_now() - emulate_start;
+        }
+
+        // keep the tone queued a couple of frames ahead of the virtual
+        // clock. cut it short when FX18 moves its end earlier or zeroes ST.
+        const uint64_t tone_end =
+            cpu_st(cpu) > 0 ? cpu_sound_end(cpu) : cpu->cycles;
+        if (tone_end < sound_end) {
+            audio_stop(audio);
+            sound_end = cpu->cycles;
+        }
+        if (sound_end < cpu->cycles) {
+            sound_end = cpu->cycles;
+        }
+        const uint64_t horizon = cpu->cycles + cycles_per_second / 30U;
+        const uint64_t queue_end = tone_end < horizon ? tone_end : horizon;
+        if (queue_end > sound_end) {
+            audio_beep(audio, (int32_t)((queue_end - sound_end) *
+                                        AUDIO_FREQUENCY / cycles_per_second));
+            sound_end = queue_end;
         }
 
         while (frame_delta >= MILLISECONDS_PER_FRAME) {
-            cpu_update_timers(cpu);
-            graphics_draw(cpu->graphics);
+            if (cpu->draw_flag) {
+                if (stream) {
+                    stream_publish(stream, 0, cpu->display, (uint32_t)frame);
+                }
+                const uint64_t render_start = latency ? latency_now() : 0;
+                graphics_draw(graphics, cpu->display);
+                const uint64_t present_start = latency ? latency_now() : 0;
+                graphics_present(graphics);
+                if (latency) {
+                    const uint64_t end = latency_now();
+                    latency_record(latency, LATENCY_FRAME_RENDER,
+                                   present_start - render_start);
+                    latency_record(latency, LATENCY_FRAME_PRESENT,
+                                   end - present_start);
+                    latency_present(latency);
+                }
+                cpu->draw_flag = false;
+            }
+            if (record) {
+                record_frame(record, cpu->display, cpu_st(cpu) > 0);
+            }
+            if (export) {
+                export_publish(export, 0, cpu, frame);
+                export_poll_input(export, 0, cpu);
+            }
+            if (latency) {
+                latency_record(latency, LATENCY_FRAME_EMULATE, emulate_ns);
+                latency_frame(latency);
+                emulate_ns = 0;
+            }
+            frame++;
             frame_delta -= MILLISECONDS_PER_FRAME;
         }
+        if (stream) {
+            stream_poll(stream, 0);
+        }
     }
 
-QUIT:
+cleanup:
+    latency_destroy(latency);
+    audio_destroy(audio);
+    graphics_destroy(graphics);
+    record_destroy(record);
+    stream_destroy(stream);
+    export_destroy(export);
+    trace_destroy(trace);
     cpu_destroy(cpu);
+    cpu_pool_destroy(&pool);
+    rom_destroy(rom);
+    pack_close(pack);
     SDL_Quit();
-    return 0;
+    return status;
 }
@@ -0,0 +1,165 @@
+#include "mem.h"
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "hash.h"
+
+// 4x5 pixel digits 0-F
+#define FONT_SMALL \
+    0xF0U, 0x90U, 0x90U, 0x90U, 0xF0U, \
+    0x20U, 0x60U, 0x20U, 0x20U, 0x70U, \
+    0xF0U, 0x10U, 0xF0U, 0x80U, 0xF0U, \
+    0xF0U, 0x10U, 0xF0U, 0x10U, 0xF0U, \
+    0x90U, 0x90U, 0xF0U, 0x10U, 0x10U, \
+    0xF0U, 0x80U, 0xF0U, 0x10U, 0xF0U, \
+    0xF0U, 0x80U, 0xF0U, 0x90U, 0xF0U, \
+    0xF0U, 0x10U, 0x20U, 0x40U, 0x40U, \
+    0xF0U, 0x90U, 0xF0U, 0x90U, 0xF0U, \
+    0xF0U, 0x90U, 0xF0U, 0x10U, 0xF0U, \
+    0xF0U, 0x90U, 0xF0U, 0x90U, 0x90U, \
+    0xE0U, 0x90U, 0xE0U, 0x90U, 0xE0U, \
+    0xF0U, 0x80U, 0x80U, 0x80U, 0xF0U, \
+    0xE0U, 0x90U, 0x90U, 0x90U, 0xE0U, \
+    0xF0U, 0x80U, 0xF0U, 0x80U, 0xF0U, \
+    0xF0U, 0x80U, 0xF0U, 0x80U, 0x80U
+
+// 0x000-0x04F holds the built in 4x5 pixel font set (0-F)
+const uint8_t mem_font_page[PAGE_MAX_SIZE] = {FONT_SMALL};
+
+// SUPER-CHIP adds an 8x10 pixel font (0-F) at 0x050-0x0EF
+const uint8_t mem_super_font_page[PAGE_MAX_SIZE] = {
+    FONT_SMALL,
+    0xFFU, 0xFFU, 0xC3U, 0xC3U, 0xC3U, 0xC3U, 0xC3U, 0xC3U, 0xFFU, 0xFFU, // 0
+    0x18U, 0x78U, 0x78U, 0x18U, 0x18U, 0x18U, 0x18U, 0x18U, 0xFFU, 0xFFU, // 1
+    0xFFU, 0xFFU, 0x03U, 0x03U, 0xFFU, 0xFFU, 0xC0U, 0xC0U, 0xFFU, 0xFFU, // 2
+    0xFFU, 0xFFU, 0x03U, 0x03U, 0xFFU, 0xFFU, 0x03U, 0x03U, 0xFFU, 0xFFU, // 3
+    0xC3U, 0xC3U, 0xC3U, 0xC3U, 0xFFU, 0xFFU, 0x03U, 0x03U, 0x03U, 0x03U, // 4
+    0xFFU, 0xFFU, 0xC0U, 0xC0U, 0xFFU, 0xFFU, 0x03U, 0x03U, 0xFFU, 0xFFU, // 5
+    0xFFU, 0xFFU, 0xC0U, 0xC0U, 0xFFU, 0xFFU, 0xC3U, 0xC3U, 0xFFU, 0xFFU, // 6
+    0xFFU, 0xFFU, 0x03U, 0x03U, 0x06U, 0x0CU, 0x18U, 0x18U, 0x18U, 0x18U, // 7
+    0xFFU, 0xFFU, 0xC3U, 0xC3U, 0xFFU, 0xFFU, 0xC3U, 0xC3U, 0xFFU, 0xFFU, // 8
+    0xFFU, 0xFFU, 0xC3U, 0xC3U, 0xFFU, 0xFFU, 0x03U, 0x03U, 0xFFU, 0xFFU, // 9
+    0x7EU, 0xFFU, 0xC3U, 0xC3U, 0xC3U, 0xFFU, 0xFFU, 0xC3U, 0xC3U, 0xC3U, // A
+    0xFCU, 0xFCU, 0xC3U, 0xC3U, 0xFCU, 0xFCU, 0xC3U, 0xC3U, 0xFCU, 0xFCU, // B
+    0x3CU, 0xFFU, 0xC3U, 0xC0U, 0xC0U, 0xC0U, 0xC0U, 0xC3U, 0xFFU, 0x3CU, // C
+    0xFCU, 0xFEU, 0xC3U, 0xC3U, 0xC3U, 0xC3U, 0xC3U, 0xC3U, 0xFEU, 0xFCU, // D
+    0xFFU, 0xFFU, 0xC0U, 0xC0U, 0xFFU, 0xFFU, 0xC0U, 0xC0U, 0xFFU, 0xFFU, // E
+    0xFFU, 0xFFU, 0xC0U, 0xC0U, 0xFFU, 0xFFU, 0xC0U, 0xC0U, 0xC0U, 0xC0U  // F
+};
+
+const uint8_t mem_zero_page[PAGE_MAX_SIZE] = {0};
+
+static uint32_t* page_refs(const struct cpu* cpu, uint32_t page) {
+    if (cpu->page_shift == PAGE_SHIFT) {
+        return &((struct page*)cpu->page[page])->refs;
+    }
+    return &((struct large_page*)cpu->page[page])->refs;
+}
+
+static struct pool* page_pool(const struct cpu* cpu) {
+    return cpu->page_shift == PAGE_SHIFT ? &cpu->pool->pages
+                                         : &cpu->pool->large_pages;
+}
+
+static void page_release(struct cpu* cpu, uint32_t page) {
+    const uint16_t bit = 1U << page;
+    if (cpu->page_pooled & bit) {
+        if (__atomic_sub_fetch(page_refs(cpu, page), 1, __ATOMIC_ACQ_REL) ==
+            0) {
+            pool_free(page_pool(cpu), cpu->page[page]);
+        }
+    }
+    cpu->page_pooled &= ~bit;
+    cpu->page_owned &= ~bit;
+}
+
+void mem_init(struct cpu* cpu) {
+    cpu->page_owned = 0;
+    cpu->page_pooled = 0;
+    cpu->page_dirty = 0;
+    cpu->page_unhashed = 0xFFFFU;
+    cpu->page[0] = (uint8_t*)(cpu->mode == CPU_CHIP8 ? mem_font_page
+                                                     : mem_super_font_page);
+    for (uint32_t n = 1; n < PAGE_COUNT; ++n) {
+        cpu->page[n] = (uint8_t*)mem_zero_page;
+    }
+}
+
+// maps read-only data that outlives the instance, e.g. a ROM page
+void mem_map(struct cpu* cpu, uint32_t page, const uint8_t* data) {
+    page_release(cpu, page);
+    cpu->page[page] = (uint8_t*)data;
+    cpu->page_unhashed |= 1U << page;
+}
+
+// gives the instance a private, writable copy of a page
+bool mem_unshare(struct cpu* cpu, uint32_t page) {
+    const uint16_t bit = 1U << page;
+    if ((cpu->page_pooled & bit) &&
+        __atomic_load_n(page_refs(cpu, page), __ATOMIC_ACQUIRE) == 1) {
+        // every other holder has let go of it already
+        cpu->page_owned |= bit;
+        return true;
+    }
+
+    uint8_t* copy = pool_alloc(page_pool(cpu));
+    if (!copy) {
+        fputs("Memory error", stderr);
+        return false;
+    }
+    memcpy(copy, cpu->page[page], cpu_page_size(cpu));
+
+    page_release(cpu, page);
+    cpu->page[page] = copy;
+    *page_refs(cpu, page) = 1;
+    cpu->page_pooled |= bit;
+    cpu->page_owned |= bit;
+    return true;
+}
+
+// makes cpu read page from other's copy. neither may write it in place
+// afterwards, unless it finds it has become the last holder. both must
+// run in the same mode.
+void mem_share(struct cpu* cpu, uint32_t page, struct cpu* other) {
+    const uint16_t bit = 1U << page;
+    if (cpu->page[page] == other->page[page]) {
+        return;
+    }
+    if (!(other->page_pooled & bit)) {
+        mem_map(cpu, page, other->page[page]);
+        return;
+    }
+
+    mem_retain(other, page);
+    page_release(cpu, page);
+    cpu->page[page] = other->page[page];
+    cpu->page_pooled |= bit;
+    other->page_owned &= ~bit;
+
+    if (other->page_unhashed & bit) {
+        cpu->page_unhashed |= bit;
+    } else {
+        cpu->page_hash[page] = other->page_hash[page];
+        cpu->page_unhashed &= ~bit;
+    }
+}
+
+void mem_retain(struct cpu* cpu, uint32_t page) {
+    __atomic_add_fetch(page_refs(cpu, page), 1, __ATOMIC_RELAXED);
+}
+
+void mem_hash(struct cpu* cpu) {
+    for (uint32_t pending = cpu->page_unhashed; pending;
+         pending &= pending - 1) {
+        const uint32_t page = __builtin_ctz(pending);
+        cpu->page_hash[page] =
+            hash_bytes(cpu->page[page], cpu_page_size(cpu), page);
+    }
+    cpu->page_unhashed = 0;
+}
+
+void mem_release(struct cpu* cpu) {
+    for (uint32_t n = 0; n < PAGE_COUNT; ++n) {
+        page_release(cpu, n);
+    }
+}
@@ -0,0 +1,160 @@
+#include "pack.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "hash.h"
+#include "mem.h"
+
+struct pack {
+    const uint8_t* data;
+    size_t size;
+    const struct pack_header* header;
+    const struct pack_entry* entries;
+    const uint32_t* index;
+};
+
+// true if [offset, offset + len) lies within the file
+static bool in_file(const struct pack* pack, uint64_t offset, uint64_t len) {
+    return offset <= pack->size && len <= pack->size - offset;
+}
+
+static bool header_valid(const struct pack* pack) {
+    const struct pack_header* header = pack->header;
+    return header->magic == PACK_MAGIC && header->version == PACK_VERSION &&
+           header->size == pack->size && header->slots != 0 &&
+           (header->slots & (header->slots - 1)) == 0 &&
+           header->count < header->slots &&
+           header->entries % _Alignof(struct pack_entry) == 0 &&
+           header->index % _Alignof(uint32_t) == 0 &&
+           in_file(pack, header->entries,
+                   (uint64_t)header->count * sizeof(struct pack_entry)) &&
+           in_file(pack, header->index,
+                   (uint64_t)header->slots * sizeof(uint32_t)) &&
+           in_file(pack, header->names, 0);
+}
+
+struct pack* pack_open(const char* filename) {
+    const int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fputs("File error", stderr);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (size_t)st.st_size < sizeof(struct pack_header)) {
+        printf("Error: not a chip8 pack");
+        close(fd);
+        return NULL;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fputs("File error", stderr);
+        return NULL;
+    }
+
+    struct pack* pack = malloc(sizeof(struct pack));
+    if (!pack) {
+        fputs("Memory error", stderr);
+        munmap(data, st.st_size);
+        return NULL;
+    }
+    *pack = (struct pack){
+        .data = data,
+        .size = st.st_size,
+        .header = data,
+    };
+    if (!header_valid(pack)) {
+        printf("Error: not a chip8 pack");
+        pack_close(pack);
+        return NULL;
+    }
+    const struct pack_header* header = pack->header;
+    pack->entries = (const struct pack_entry*)&pack->data[header->entries];
+    pack->index = (const uint32_t*)&pack->data[header->index];
+    return pack;
+}
+
+void pack_close(struct pack* pack) {
+    if (!pack) {
+        return;
+    }
+    munmap((void*)pack->data, pack->size);
+    free(pack);
+}
+
+uint32_t pack_count(const struct pack* pack) {
+    return pack->header->count;
+}
+
+uint64_t pack_key(const char* name) {
+    return hash_bytes(name, strlen(name), 0);
+}
+
+// entries are only checked once they are used, so opening stays O(1)
+static const char* entry_name(const struct pack* pack,
+                              const struct pack_entry* entry) {
+    const uint64_t offset = pack->header->names + entry->name;
+    if (!in_file(pack, offset, 1) ||
+        !memchr(&pack->data[offset], '\0', pack->size - offset)) {
+        return NULL;
+    }
+    return (const char*)&pack->data[offset];
+}
+
+bool pack_get(const struct pack* pack, uint32_t index, struct pack_rom* out) {
+    if (index >= pack->header->count) {
+        return false;
+    }
+    const struct pack_entry* entry = &pack->entries[index];
+    const uint64_t padded =
+        ((uint64_t)entry->size + PAGE_MASK) & ~(uint64_t)PAGE_MASK;
+    const char* name = entry_name(pack, entry);
+    if (!name || entry->offset % PAGE_SIZE != 0 ||
+        entry->size > MEMORY_MAX_SIZE - APP_MEMORY_OFFSET ||
+        !in_file(pack, entry->offset, padded)) {
+        printf("Error: corrupt pack entry %u", index);
+        return false;
+    }
+
+    *out = (struct pack_rom){
+        .rom =
+            {
+                .data = (uint8_t*)&pack->data[entry->offset],
+                .size = entry->size,
+            },
+        .name = name,
+        .ipf = entry->ipf,
+        .profile = entry->profile,
+    };
+    return true;
+}
+
+bool pack_find(const struct pack* pack, const char* name,
+               struct pack_rom* out) {
+    const uint64_t key = pack_key(name);
+    const uint32_t mask = pack->header->slots - 1;
+
+    // a well formed index always has an empty slot to stop at
+    for (uint32_t probe = 0; probe <= mask; ++probe) {
+        const uint32_t n = pack->index[(key + probe) & mask];
+        if (n == 0 || n > pack->header->count) {
+            return false;
+        }
+        const struct pack_entry* entry = &pack->entries[n - 1];
+        if (entry->key != key) {
+            continue;
+        }
+        const char* found = entry_name(pack, entry);
+        if (found && strcmp(found, name) == 0) {
+            return pack_get(pack, n - 1, out);
+        }
+    }
+    return false;
+}
@@ -0,0 +1,83 @@
+#include "pool.h"
+#include <stdlib.h>
+
+static size_t align_up(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+}
+
+int32_t pool_init(struct pool* pool, size_t block_size, size_t align,
+                  size_t blocks_per_chunk) {
+    if (!pool || block_size == 0 || blocks_per_chunk == 0) {
+        return 1;
+    }
+    if (align < sizeof(void*)) {
+        align = sizeof(void*);
+    }
+
+    *pool = (struct pool){
+        .block_size = align_up(block_size, align),
+        .align = align,
+        .blocks_per_chunk = blocks_per_chunk,
+        .free_list = NULL,
+        .chunks = NULL,
+        .allocated = 0,
+    };
+    return 0;
+}
+
+static bool pool_grow(struct pool* pool) {
+    // the first block slot of every chunk links it into pool->chunks
+    const size_t header = align_up(sizeof(void*), pool->align);
+    void* chunk = NULL;
+    if (posix_memalign(&chunk, pool->align,
+                       header + pool->block_size * pool->blocks_per_chunk) !=
+        0) {
+        return false;
+    }
+    *(void**)chunk = pool->chunks;
+    pool->chunks = chunk;
+
+    // push back to front so blocks are handed out in address order
+    uint8_t* block = (uint8_t*)chunk + header +
+                     pool->block_size * pool->blocks_per_chunk;
+    for (size_t i = 0; i < pool->blocks_per_chunk; ++i) {
+        block -= pool->block_size;
+        *(void**)block = pool->free_list;
+        pool->free_list = block;
+    }
+    return true;
+}
+
+void* pool_alloc(struct pool* pool) {
+    if (!pool->free_list && !pool_grow(pool)) {
+        return NULL;
+    }
+    void* block = pool->free_list;
+    pool->free_list = *(void**)block;
+    pool->allocated++;
+    return block;
+}
+
+void pool_free(struct pool* pool, void* block) {
+    if (!block) {
+        return;
+    }
+    *(void**)block = pool->free_list;
+    pool->free_list = block;
+    pool->allocated--;
+}
+
+void pool_destroy(struct pool* pool) {
+    if (!pool) {
+        return;
+    }
+    void* chunk = pool->chunks;
+    while (chunk) {
+        void* next = *(void**)chunk;
+        free(chunk);
+        chunk = next;
+    }
+    pool->chunks = NULL;
+    pool->free_list = NULL;
+    pool->allocated = 0;
+}
@@ -0,0 +1,218 @@
+#include "record.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "delta.h"
+#include "spsc.h"
+
+#define RECORD_MAGIC 0x56523843U // "C8RV"
+#define RECORD_VERSION 2
+
+// frame tags
+#define RECORD_SOUND 1U
+#define RECORD_CHANGED 2U
+
+struct record_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t fps;
+};
+
+struct record {
+    struct spsc queue;
+    // only touched by the emulating thread
+    uint64_t dropped;
+
+    FILE* file;
+    bool wait;
+    bool failed;
+    struct drainer encoder;
+
+    // encoder state
+    struct display display;
+    uint8_t delta[DELTA_MAX_BYTES];
+
+    struct record_frame frames[RECORD_QUEUE_FRAMES];
+};
+
+struct record_reader {
+    FILE* file;
+    struct display display;
+    uint8_t delta[DELTA_MAX_BYTES];
+};
+
+static void encode(struct record* record, const struct record_frame* frame) {
+    if (record->failed) {
+        return;
+    }
+    uint8_t tag = frame->sound ? RECORD_SOUND : 0;
+    const bool changed = memcmp(&frame->display, &record->display,
+                                sizeof(record->display)) != 0;
+    if (!changed) {
+        if (fputc(tag, record->file) == EOF) {
+            fputs("Recording error", stderr);
+            record->failed = true;
+        }
+        return;
+    }
+
+    tag |= RECORD_CHANGED;
+    const uint16_t size =
+        (uint16_t)delta_encode(&record->display, &frame->display,
+                               record->delta);
+    record->display = frame->display;
+    if (fputc(tag, record->file) == EOF ||
+        fwrite(&size, sizeof(size), 1, record->file) != 1 ||
+        fwrite(record->delta, 1, size, record->file) != size) {
+        // keep draining so the emulator never notices
+        fputs("Recording error", stderr);
+        record->failed = true;
+    }
+}
+
+// kicked every quarter queue, the drainer's timeout picks up the rest
+static bool drain(void* context) {
+    struct record* record = context;
+    const uint64_t head = spsc_head(&record->queue);
+    uint64_t tail = record->queue.tail;
+    if (tail == head) {
+        return false;
+    }
+    for (; tail != head; ++tail) {
+        encode(record, &record->frames[tail & (RECORD_QUEUE_FRAMES - 1)]);
+        spsc_release(&record->queue, tail + 1);
+    }
+    return true;
+}
+
+struct record* record_create(const char* filename, bool wait) {
+    struct record* record = NULL;
+    if (posix_memalign((void**)&record, 64, sizeof(struct record)) != 0) {
+        fputs("Memory error", stderr);
+        return NULL;
+    }
+    memset(record, 0, sizeof(struct record));
+    record->wait = wait;
+    record->display = display_blank[0];
+
+    record->file = fopen(filename, "wbe");
+    if (!record->file) {
+        fputs("File error", stderr);
+        free(record);
+        return NULL;
+    }
+
+    const struct record_header header = {
+        .magic = RECORD_MAGIC,
+        .version = RECORD_VERSION,
+        .fps = RECORD_FPS,
+    };
+    if (fwrite(&header, sizeof(header), 1, record->file) != 1) {
+        fputs("Recording error", stderr);
+        fclose(record->file);
+        free(record);
+        return NULL;
+    }
+
+    if (drainer_start(&record->encoder, drain, record) != 0) {
+        printf("Error: failed to start the recorder");
+        fclose(record->file);
+        free(record);
+        return NULL;
+    }
+    return record;
+}
+
+void record_frame(struct record* record, const struct display* display,
+                  bool sound) {
+    const uint64_t head = record->queue.head;
+    if (spsc_used(&record->queue) == RECORD_QUEUE_FRAMES) {
+        if (!record->wait) {
+            record->dropped++;
+            return;
+        }
+        drainer_wait(&record->encoder, &record->queue, RECORD_QUEUE_FRAMES);
+    }
+
+    struct record_frame* frame =
+        &record->frames[head & (RECORD_QUEUE_FRAMES - 1)];
+    frame->display = *display;
+    frame->sound = sound;
+    spsc_push(&record->queue);
+
+    if ((head + 1) % (RECORD_QUEUE_FRAMES / 4) == 0) {
+        drainer_kick(&record->encoder);
+    }
+}
+
+void record_destroy(struct record* record) {
+    if (!record) {
+        return;
+    }
+    drainer_stop(&record->encoder);
+
+    if (fclose(record->file) != 0 && !record->failed) {
+        fputs("Recording error", stderr);
+    }
+    if (record->dropped) {
+        printf("Warning: %llu frames were dropped from the recording\n",
+               (unsigned long long)record->dropped);
+    }
+    free(record);
+}
+
+struct record_reader* record_open(const char* filename) {
+    struct record_reader* reader = calloc(1, sizeof(struct record_reader));
+    if (!reader) {
+        fputs("Memory error", stderr);
+        return NULL;
+    }
+    reader->display = display_blank[0];
+
+    reader->file = fopen(filename, "rbe");
+    if (!reader->file) {
+        fputs("File error", stderr);
+        free(reader);
+        return NULL;
+    }
+
+    struct record_header header;
+    if (fread(&header, sizeof(header), 1, reader->file) != 1 ||
+        header.magic != RECORD_MAGIC || header.version != RECORD_VERSION ||
+        header.fps != RECORD_FPS) {
+        printf("Error: %s is not a chip8 recording\n", filename);
+        fclose(reader->file);
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+bool record_next(struct record_reader* reader, struct record_frame* frame) {
+    const int tag = fgetc(reader->file);
+    if (tag == EOF) {
+        return false;
+    }
+
+    if (tag & RECORD_CHANGED) {
+        uint16_t size;
+        if (fread(&size, sizeof(size), 1, reader->file) != 1 ||
+            size > sizeof(reader->delta) ||
+            fread(reader->delta, 1, size, reader->file) != size ||
+            !delta_apply(&reader->display, reader->delta, size)) {
+            printf("Error: corrupt recording\n");
+            return false;
+        }
+    }
+    frame->display = reader->display;
+    frame->sound = tag & RECORD_SOUND;
+    return true;
+}
+
+void record_close(struct record_reader* reader) {
+    if (!reader) {
+        return;
+    }
+    fclose(reader->file);
+    free(reader);
+}
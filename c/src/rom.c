@@ -0,0 +1,71 @@
+#include "rom.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "mem.h"
+
+static int64_t get_file_size(FILE* file) {
+    const int32_t result = fseek(file, 0, SEEK_END);
+    if (result != 0) {
+        return -1;
+    }
+
+    long file_size = ftell(file);
+    rewind(file);
+    return file_size;
+}
+
+struct rom* rom_load(const char* filename) {
+    FILE* file = fopen(filename, "rbe");
+    if (file == NULL) {
+        fputs("File error", stderr);
+        return NULL;
+    }
+
+    int64_t file_size = get_file_size(file);
+    if (file_size < 0) {
+        printf("Error: failed to get ROM size");
+        fclose(file);
+        return NULL;
+    }
+
+    if (file_size > MEMORY_MAX_SIZE - APP_MEMORY_OFFSET) {
+        printf("Error: ROM too big for memory");
+        fclose(file);
+        return NULL;
+    }
+
+    struct rom* rom = malloc(sizeof(struct rom));
+    const size_t padded_size = (file_size + PAGE_MASK) & ~(size_t)PAGE_MASK;
+    uint8_t* data = calloc(padded_size ? padded_size : PAGE_SIZE, 1);
+    if (rom == NULL || data == NULL) {
+        fputs("Memory error", stderr);
+        fclose(file);
+        free(rom);
+        free(data);
+        return NULL;
+    }
+
+    size_t len = fread(data, 1, file_size, file);
+    if (len != (uint64_t)file_size) {
+        fputs("Reading error", stderr);
+        fclose(file);
+        free(rom);
+        free(data);
+        return NULL;
+    }
+
+    fclose(file);
+    *rom = (struct rom){
+        .data = data,
+        .size = file_size,
+    };
+    return rom;
+}
+
+void rom_destroy(struct rom* rom) {
+    if (!rom) {
+        return;
+    }
+    free(rom->data);
+    free(rom);
+}
@@ -0,0 +1,36 @@
+#include "runs.h"
+#include <string.h>
+
+void runs_flush_zeros(struct runs* runs) {
+    while (runs->zeros) {
+        const size_t run = runs->zeros < 128 ? runs->zeros : 128;
+        runs->out[runs->size++] = (uint8_t)(0x7F + run);
+        runs->zeros -= run;
+    }
+}
+
+size_t runs_unpack(const uint8_t* in, size_t size, uint8_t* out,
+                   size_t len) {
+    size_t n = 0;
+    size_t k = 0;
+    while (k < size) {
+        const uint8_t c = in[k++];
+        if (c >= 0x80) {
+            const size_t run = c - 0x7FU;
+            if (n + run > len) {
+                return SIZE_MAX;
+            }
+            memset(out + n, 0, run);
+            n += run;
+        } else {
+            const size_t literal = c + 1U;
+            if (n + literal > len || k + literal > size) {
+                return SIZE_MAX;
+            }
+            memcpy(out + n, in + k, literal);
+            n += literal;
+            k += literal;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,56 @@
+#include "spsc.h"
+#include <sched.h>
+#include <time.h>
+
+static void* run(void* arg) {
+    struct drainer* drainer = arg;
+
+    while (true) {
+        const bool stop = __atomic_load_n(&drainer->stop, __ATOMIC_ACQUIRE);
+        const bool drained = drainer->drain(drainer->context);
+        if (stop) {
+            break;
+        }
+        if (!drained) {
+            struct timespec idle;
+            clock_gettime(CLOCK_REALTIME, &idle);
+            idle.tv_nsec += 10000000;
+            if (idle.tv_nsec >= 1000000000) {
+                idle.tv_sec++;
+                idle.tv_nsec -= 1000000000;
+            }
+            sem_timedwait(&drainer->wake, &idle);
+        }
+    }
+    return NULL;
+}
+
+int32_t drainer_start(struct drainer* drainer, bool (*drain)(void* context),
+                      void* context) {
+    *drainer = (struct drainer){.drain = drain, .context = context};
+    sem_init(&drainer->wake, 0, 0);
+    if (pthread_create(&drainer->thread, NULL, run, drainer) != 0) {
+        sem_destroy(&drainer->wake);
+        return 1;
+    }
+    return 0;
+}
+
+void drainer_kick(struct drainer* drainer) {
+    sem_post(&drainer->wake);
+}
+
+void drainer_wait(struct drainer* drainer, const struct spsc* queue,
+                  uint64_t size) {
+    drainer_kick(drainer);
+    while (spsc_used(queue) == size) {
+        sched_yield();
+    }
+}
+
+void drainer_stop(struct drainer* drainer) {
+    __atomic_store_n(&drainer->stop, true, __ATOMIC_RELEASE);
+    sem_post(&drainer->wake);
+    pthread_join(drainer->thread, NULL);
+    sem_destroy(&drainer->wake);
+}
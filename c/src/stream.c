@@ -0,0 +1,384 @@
+#include "stream.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define STREAM_EVENTS 64
+
+struct stream_instance {
+    struct display display;
+    uint32_t frame;
+    uint32_t updates;
+};
+
+struct stream_client {
+    int fd;
+    bool closed;
+    bool want_write;
+    // instances owed a keyframe, set on subscribing and after skipping
+    bool has_stale;
+
+    // ids arrive 4 bytes at a time
+    uint8_t request[sizeof(uint32_t)];
+    uint32_t request_len;
+
+    // bitsets over the instances
+    uint64_t* subscribed;
+    uint64_t* stale;
+
+    uint8_t* out;
+    size_t out_start;
+    size_t out_end;
+};
+
+struct stream {
+    int listen_fd;
+    int epoll_fd;
+    char path[sizeof(((struct sockaddr_un*)NULL)->sun_path)];
+
+    uint32_t instance_count;
+    uint32_t words;
+    struct stream_instance* instances;
+
+    uint32_t client_count;
+    struct stream_client* clients[STREAM_MAX_CLIENTS];
+
+    uint8_t delta[DELTA_MAX_BYTES];
+    uint8_t key[DELTA_MAX_BYTES];
+};
+
+static bool test_bit(const uint64_t* bits, uint32_t n) {
+    return (bits[n / 64] >> (n % 64)) & 1U;
+}
+
+static void set_bit(uint64_t* bits, uint32_t n) {
+    bits[n / 64] |= 1ULL << (n % 64);
+}
+
+static void clear_bit(uint64_t* bits, uint32_t n) {
+    bits[n / 64] &= ~(1ULL << (n % 64));
+}
+
+struct stream* stream_create(const char* path, uint32_t instances) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("Error: socket path too long");
+        return NULL;
+    }
+    strcpy(addr.sun_path, path);
+
+    struct stream* stream = calloc(1, sizeof(struct stream));
+    struct stream_instance* list =
+        calloc(instances ? instances : 1, sizeof(struct stream_instance));
+    if (!stream || !list) {
+        fputs("Memory error", stderr);
+        free(stream);
+        free(list);
+        return NULL;
+    }
+    strcpy(stream->path, path);
+    stream->instance_count = instances;
+    stream->words = (instances + 63) / 64;
+    stream->instances = list;
+    for (uint32_t n = 0; n < instances; ++n) {
+        list[n].display = display_blank[0];
+    }
+
+    stream->listen_fd =
+        socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    stream->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (stream->listen_fd >= 0) {
+        unlink(path);
+    }
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (stream->listen_fd < 0 || stream->epoll_fd < 0 ||
+        bind(stream->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(stream->listen_fd, 16) != 0 ||
+        epoll_ctl(stream->epoll_fd, EPOLL_CTL_ADD, stream->listen_fd,
+                  &event) != 0) {
+        printf("Error: failed to listen on %s", path);
+        if (stream->listen_fd >= 0) {
+            close(stream->listen_fd);
+        }
+        if (stream->epoll_fd >= 0) {
+            close(stream->epoll_fd);
+        }
+        free(list);
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+static void client_destroy(struct stream* stream, struct stream_client* c) {
+    epoll_ctl(stream->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->subscribed);
+    free(c->stale);
+    free(c->out);
+    free(c);
+}
+
+void stream_destroy(struct stream* stream) {
+    if (!stream) {
+        return;
+    }
+    for (uint32_t n = 0; n < stream->client_count; ++n) {
+        client_destroy(stream, stream->clients[n]);
+    }
+    close(stream->listen_fd);
+    close(stream->epoll_fd);
+    unlink(stream->path);
+    free(stream->instances);
+    free(stream);
+}
+
+uint32_t stream_clients(const struct stream* stream) {
+    return stream->client_count;
+}
+
+static void accept_clients(struct stream* stream) {
+    while (true) {
+        const int fd = accept(stream->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        if (stream->client_count == STREAM_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+
+        struct stream_client* c = calloc(1, sizeof(struct stream_client));
+        uint64_t* subscribed = calloc(stream->words + 1, sizeof(uint64_t));
+        uint64_t* stale = calloc(stream->words + 1, sizeof(uint64_t));
+        uint8_t* out = malloc(STREAM_CLIENT_BUFFER);
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = c};
+        if (!c || !subscribed || !stale || !out ||
+            epoll_ctl(stream->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            fputs("Memory error", stderr);
+            close(fd);
+            free(c);
+            free(subscribed);
+            free(stale);
+            free(out);
+            continue;
+        }
+        c->fd = fd;
+        c->subscribed = subscribed;
+        c->stale = stale;
+        c->out = out;
+        stream->clients[stream->client_count++] = c;
+    }
+}
+
+static void subscribe(struct stream* stream, struct stream_client* c,
+                      uint32_t id) {
+    if (id == STREAM_ALL) {
+        for (uint32_t n = 0; n < stream->instance_count; ++n) {
+            set_bit(c->subscribed, n);
+            set_bit(c->stale, n);
+        }
+    } else if (id < stream->instance_count) {
+        set_bit(c->subscribed, id);
+        set_bit(c->stale, id);
+    } else {
+        return;
+    }
+    c->has_stale = true;
+}
+
+static void read_requests(struct stream* stream, struct stream_client* c) {
+    uint8_t buffer[256];
+    while (true) {
+        const ssize_t len = recv(c->fd, buffer, sizeof(buffer), 0);
+        if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR)) {
+            c->closed = true;
+            return;
+        }
+        if (len < 0) {
+            return;
+        }
+        for (ssize_t n = 0; n < len; ++n) {
+            c->request[c->request_len++] = buffer[n];
+            if (c->request_len == sizeof(c->request)) {
+                uint32_t id;
+                memcpy(&id, c->request, sizeof(id));
+                subscribe(stream, c, id);
+                c->request_len = 0;
+            }
+        }
+    }
+}
+
+static bool queue(struct stream_client* c, const struct stream_message* msg,
+                  const uint8_t* data) {
+    const size_t len = sizeof(*msg) + msg->size;
+    if (c->out_end + len > STREAM_CLIENT_BUFFER) {
+        memmove(c->out, &c->out[c->out_start], c->out_end - c->out_start);
+        c->out_end -= c->out_start;
+        c->out_start = 0;
+        if (c->out_end + len > STREAM_CLIENT_BUFFER) {
+            return false;
+        }
+    }
+    memcpy(&c->out[c->out_end], msg, sizeof(*msg));
+    memcpy(&c->out[c->out_end + sizeof(*msg)], data, msg->size);
+    c->out_end += len;
+    return true;
+}
+
+static void flush(struct stream* stream, struct stream_client* c) {
+    while (c->out_start < c->out_end) {
+        const ssize_t len = send(c->fd, &c->out[c->out_start],
+                                 c->out_end - c->out_start, MSG_NOSIGNAL);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                c->closed = true;
+                return;
+            }
+            break;
+        }
+        c->out_start += len;
+    }
+    if (c->out_start == c->out_end) {
+        c->out_start = 0;
+        c->out_end = 0;
+    }
+
+    // only ask for EPOLLOUT while something is pending
+    const bool want_write = c->out_end != 0;
+    if (want_write != c->want_write) {
+        struct epoll_event event = {
+            .events = EPOLLIN | (want_write ? EPOLLOUT : 0),
+            .data.ptr = c,
+        };
+        epoll_ctl(stream->epoll_fd, EPOLL_CTL_MOD, c->fd, &event);
+        c->want_write = want_write;
+    }
+}
+
+static bool send_keyframe(struct stream* stream, struct stream_client* c,
+                          uint32_t id) {
+    const struct stream_instance* instance = &stream->instances[id];
+    const struct stream_message msg = {
+        .instance = id,
+        .frame = instance->frame,
+        .size = (uint16_t)delta_encode(NULL, &instance->display, stream->key),
+        .type = STREAM_KEYFRAME,
+    };
+    return queue(c, &msg, stream->key);
+}
+
+// sends keyframes owed to a client for as long as its buffer has room
+static void resync(struct stream* stream, struct stream_client* c) {
+    for (uint32_t w = 0; w < stream->words; ++w) {
+        uint64_t bits = c->stale[w];
+        while (bits) {
+            const uint32_t id = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (!send_keyframe(stream, c, id)) {
+                return;
+            }
+            clear_bit(c->stale, id);
+        }
+    }
+    c->has_stale = false;
+}
+
+static void service_clients(struct stream* stream) {
+    for (uint32_t n = 0; n < stream->client_count;) {
+        struct stream_client* c = stream->clients[n];
+        if (c->has_stale && !c->closed) {
+            resync(stream, c);
+        }
+        if (!c->closed) {
+            flush(stream, c);
+        }
+        if (c->closed) {
+            client_destroy(stream, c);
+            stream->clients[n] = stream->clients[--stream->client_count];
+            continue;
+        }
+        n++;
+    }
+}
+
+void stream_poll(struct stream* stream, int32_t timeout_ms) {
+    // send what the last frame queued before sleeping
+    service_clients(stream);
+
+    struct epoll_event events[STREAM_EVENTS];
+    const int count =
+        epoll_wait(stream->epoll_fd, events, STREAM_EVENTS, timeout_ms);
+    for (int n = 0; n < count; ++n) {
+        struct stream_client* c = events[n].data.ptr;
+        if (!c) {
+            accept_clients(stream);
+            continue;
+        }
+        if (events[n].events & (EPOLLERR | EPOLLHUP)) {
+            c->closed = true;
+        } else if (events[n].events & EPOLLIN) {
+            read_requests(stream, c);
+        }
+    }
+    service_clients(stream);
+}
+
+void stream_publish(struct stream* stream, uint32_t instance,
+                    const struct display* display, uint32_t frame) {
+    if (instance >= stream->instance_count) {
+        return;
+    }
+    struct stream_instance* state = &stream->instances[instance];
+    const bool key = ++state->updates >= STREAM_KEYFRAME_INTERVAL;
+    if (key) {
+        state->updates = 0;
+    }
+    struct stream_message msg = {
+        .instance = instance,
+        .frame = frame,
+        .type = key ? STREAM_KEYFRAME : STREAM_DELTA,
+    };
+    uint8_t* data = key ? stream->key : stream->delta;
+    // encoded at most once, and only if someone is listening
+    bool encoded = false;
+
+    for (uint32_t n = 0; n < stream->client_count; ++n) {
+        struct stream_client* c = stream->clients[n];
+        const bool stale = test_bit(c->stale, instance);
+        if (c->closed || !test_bit(c->subscribed, instance) ||
+            (stale && !key)) {
+            // stale clients catch up in stream_poll
+            continue;
+        }
+        if (!encoded) {
+            msg.size = (uint16_t)delta_encode(key ? NULL : &state->display,
+                                              display, data);
+            encoded = true;
+        }
+        if (queue(c, &msg, data)) {
+            if (stale) {
+                clear_bit(c->stale, instance);
+            }
+        } else {
+            // skip ahead and resync once there is room
+            set_bit(c->stale, instance);
+            c->has_stale = true;
+        }
+    }
+
+    state->display = *display;
+    state->frame = frame;
+}
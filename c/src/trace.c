@@ -0,0 +1,368 @@
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+#include "runs.h"
+
+#define TRACE_MAGIC 0x52543843U // "C8TR"
+#define TRACE_VERSION 1
+#define TRACE_COMPRESSED 1U
+
+// records per block, bounds the writer's scratch buffers
+#define TRACE_BLOCK 4096U
+#define TRACE_BLOCK_BYTES (TRACE_BLOCK * sizeof(struct trace_record))
+#define TRACE_PACKED_BYTES RUNS_MAX_BYTES(TRACE_BLOCK_BYTES)
+
+struct trace_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+};
+
+struct trace_block {
+    uint32_t ring;
+    uint32_t count;
+    uint32_t size;
+};
+
+// last record and successor seen at every address. a loop body XORed
+// against its previous iteration is mostly zeros.
+struct trace_history {
+    uint16_t pc;
+    uint16_t next[MEMORY_MAX_SIZE];
+    struct trace_record at[MEMORY_MAX_SIZE];
+};
+
+struct trace {
+    FILE* file;
+    bool compress;
+    bool failed;
+    struct drainer writer;
+    pthread_mutex_t lock;
+
+    uint32_t ring_count;
+    struct trace_ring* rings[TRACE_MAX_RINGS];
+    struct trace_history* history[TRACE_MAX_RINGS];
+
+    uint8_t packed[TRACE_PACKED_BYTES];
+};
+
+struct trace_reader {
+    FILE* file;
+    bool compress;
+    struct trace_history* history[TRACE_MAX_RINGS];
+
+    struct trace_block block;
+    uint32_t next;
+    struct trace_record records[TRACE_BLOCK];
+    uint8_t packed[TRACE_PACKED_BYTES];
+};
+
+// records are packed as they are encoded, and an all zero record only bumps
+// the pending run, which keeps the writer well ahead of the interpreter
+static void pack_record(struct runs* runs, const struct trace_record* record) {
+    uint8_t bytes[sizeof(struct trace_record)];
+    uint64_t word;
+    memcpy(&word, record, sizeof(word));
+    if (!word) {
+        runs_zeros(runs, sizeof(word));
+        return;
+    }
+    memcpy(bytes, record, sizeof(bytes));
+    runs_bytes(runs, bytes, sizeof(bytes));
+}
+
+static void xor_records(struct trace_record* out, const struct trace_record* a,
+                        const struct trace_record* b) {
+    *out = (struct trace_record){
+        .pc = a->pc ^ b->pc,
+        .opcode = a->opcode ^ b->opcode,
+        .i = a->i ^ b->i,
+        .reg = a->reg ^ b->reg,
+        .value = a->value ^ b->value,
+    };
+}
+
+/*
+compressed records hold pc XOR the pc that followed the previous
+instruction last time, or the next one in line, and every other field XOR
+the record last executed at the same pc.
+*/
+static uint16_t predict_pc(const struct trace_history* history) {
+    const uint16_t next = history->next[history->pc & MEMORY_MAX_MASK];
+    return next ? next : history->pc + 2;
+}
+
+static void follow_pc(struct trace_history* history, uint16_t pc) {
+    history->next[history->pc & MEMORY_MAX_MASK] = pc;
+    history->pc = pc;
+}
+
+static void encode_record(struct trace_history* history,
+                          const struct trace_record* record,
+                          struct trace_record* out) {
+    struct trace_record* prev = &history->at[record->pc & MEMORY_MAX_MASK];
+    xor_records(out, record, prev);
+    out->pc = record->pc ^ predict_pc(history);
+    follow_pc(history, record->pc);
+    *prev = *record;
+}
+
+static void decode_record(struct trace_history* history,
+                          const struct trace_record* in,
+                          struct trace_record* out) {
+    const uint16_t pc = in->pc ^ predict_pc(history);
+    struct trace_record* prev = &history->at[pc & MEMORY_MAX_MASK];
+    xor_records(out, in, prev);
+    out->pc = pc;
+    follow_pc(history, pc);
+    *prev = *out;
+}
+
+static void write_block(struct trace* trace, uint32_t ring,
+                        const struct trace_record* records, uint32_t count) {
+    if (trace->failed) {
+        return;
+    }
+
+    struct trace_block block = {.ring = ring, .count = count};
+    const void* payload = records;
+    block.size = count * sizeof(struct trace_record);
+
+    if (trace->compress) {
+        struct runs runs = {.out = trace->packed};
+        for (uint32_t n = 0; n < count; ++n) {
+            struct trace_record delta;
+            encode_record(trace->history[ring], &records[n], &delta);
+            pack_record(&runs, &delta);
+        }
+        runs_flush_zeros(&runs);
+        block.size = runs.size;
+        payload = trace->packed;
+    }
+
+    if (fwrite(&block, sizeof(block), 1, trace->file) != 1 ||
+        fwrite(payload, 1, block.size, trace->file) != block.size) {
+        // keep draining so traced instances don't block forever
+        fputs("Trace writing error", stderr);
+        trace->failed = true;
+    }
+}
+
+static uint64_t drain_ring(struct trace* trace, struct trace_ring* ring) {
+    const uint64_t head = spsc_head(&ring->queue);
+    uint64_t tail = ring->queue.tail;
+    const uint64_t drained = head - tail;
+
+    while (tail != head) {
+        const uint32_t offset = tail & (TRACE_RING_SIZE - 1);
+        uint64_t count = head - tail;
+        if (count > TRACE_RING_SIZE - offset) {
+            count = TRACE_RING_SIZE - offset;
+        }
+        if (count > TRACE_BLOCK) {
+            count = TRACE_BLOCK;
+        }
+        write_block(trace, ring->id, &ring->records[offset], (uint32_t)count);
+        tail += count;
+        spsc_release(&ring->queue, tail);
+    }
+    return drained;
+}
+
+// rings are kicked as they fill, the drainer's timeout picks up the rest
+static bool drain(void* context) {
+    struct trace* trace = context;
+    const uint32_t count =
+        __atomic_load_n(&trace->ring_count, __ATOMIC_ACQUIRE);
+
+    uint64_t drained = 0;
+    for (uint32_t n = 0; n < count; ++n) {
+        drained += drain_ring(trace, trace->rings[n]);
+    }
+    return drained != 0;
+}
+
+struct trace* trace_create(const char* filename, bool compress) {
+    struct trace* trace = calloc(1, sizeof(struct trace));
+    if (!trace) {
+        fputs("Memory error", stderr);
+        return NULL;
+    }
+
+    trace->file = fopen(filename, "wbe");
+    if (!trace->file) {
+        fputs("File error", stderr);
+        free(trace);
+        return NULL;
+    }
+    trace->compress = compress;
+
+    const struct trace_header header = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .flags = compress ? TRACE_COMPRESSED : 0,
+    };
+    if (fwrite(&header, sizeof(header), 1, trace->file) != 1) {
+        fputs("Trace writing error", stderr);
+        fclose(trace->file);
+        free(trace);
+        return NULL;
+    }
+
+    pthread_mutex_init(&trace->lock, NULL);
+    if (drainer_start(&trace->writer, drain, trace) != 0) {
+        printf("Error: failed to start the trace writer");
+        pthread_mutex_destroy(&trace->lock);
+        fclose(trace->file);
+        free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+struct trace_ring* trace_attach(struct trace* trace) {
+    pthread_mutex_lock(&trace->lock);
+    const uint32_t id = trace->ring_count;
+    if (id == TRACE_MAX_RINGS) {
+        printf("Error: too many traced instances");
+        pthread_mutex_unlock(&trace->lock);
+        return NULL;
+    }
+
+    struct trace_ring* ring = NULL;
+    struct trace_history* history = calloc(1, sizeof(struct trace_history));
+    if (!history ||
+        posix_memalign((void**)&ring, 64, sizeof(struct trace_ring)) != 0) {
+        fputs("Memory error", stderr);
+        free(history);
+        pthread_mutex_unlock(&trace->lock);
+        return NULL;
+    }
+
+    ring->queue.head = 0;
+    ring->queue.tail = 0;
+    ring->id = id;
+    ring->trace = trace;
+    trace->rings[id] = ring;
+    trace->history[id] = history;
+    __atomic_store_n(&trace->ring_count, id + 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&trace->lock);
+    return ring;
+}
+
+void trace_destroy(struct trace* trace) {
+    if (!trace) {
+        return;
+    }
+    // everything appended before this is on disk once the writer stops
+    drainer_stop(&trace->writer);
+
+    fclose(trace->file);
+    for (uint32_t n = 0; n < trace->ring_count; ++n) {
+        free(trace->rings[n]);
+        free(trace->history[n]);
+    }
+    pthread_mutex_destroy(&trace->lock);
+    free(trace);
+}
+
+void trace_kick(struct trace_ring* ring) {
+    drainer_kick(&ring->trace->writer);
+}
+
+void trace_wait(struct trace_ring* ring) {
+    drainer_wait(&ring->trace->writer, &ring->queue, TRACE_RING_SIZE);
+}
+
+struct trace_reader* trace_open(const char* filename) {
+    struct trace_reader* reader = calloc(1, sizeof(struct trace_reader));
+    if (!reader) {
+        fputs("Memory error", stderr);
+        return NULL;
+    }
+
+    reader->file = fopen(filename, "rbe");
+    if (!reader->file) {
+        fputs("File error", stderr);
+        free(reader);
+        return NULL;
+    }
+
+    struct trace_header header;
+    if (fread(&header, sizeof(header), 1, reader->file) != 1 ||
+        header.magic != TRACE_MAGIC || header.version != TRACE_VERSION) {
+        printf("Error: %s is not a chip8 trace\n", filename);
+        fclose(reader->file);
+        free(reader);
+        return NULL;
+    }
+    reader->compress = header.flags & TRACE_COMPRESSED;
+    return reader;
+}
+
+static bool read_block(struct trace_reader* reader) {
+    struct trace_block* block = &reader->block;
+    if (fread(block, sizeof(*block), 1, reader->file) != 1) {
+        return false;
+    }
+
+    const size_t len = block->count * sizeof(struct trace_record);
+    if (block->ring >= TRACE_MAX_RINGS || block->count > TRACE_BLOCK ||
+        block->size > TRACE_PACKED_BYTES ||
+        (!reader->compress && block->size != len)) {
+        printf("Error: corrupt trace block\n");
+        return false;
+    }
+
+    uint8_t* payload = reader->compress ? reader->packed
+                                        : (uint8_t*)reader->records;
+    if (fread(payload, 1, block->size, reader->file) != block->size) {
+        printf("Error: truncated trace\n");
+        return false;
+    }
+
+    if (reader->compress) {
+        if (runs_unpack(payload, block->size, (uint8_t*)reader->records,
+                        len) != len) {
+            printf("Error: corrupt trace block\n");
+            return false;
+        }
+        struct trace_history** history = &reader->history[block->ring];
+        if (!*history && !(*history = calloc(1, sizeof(**history)))) {
+            fputs("Memory error", stderr);
+            return false;
+        }
+        for (uint32_t n = 0; n < block->count; ++n) {
+            decode_record(*history, &reader->records[n], &reader->records[n]);
+        }
+    }
+    reader->next = 0;
+    return true;
+}
+
+bool trace_next(struct trace_reader* reader, uint32_t* ring,
+                struct trace_record* record) {
+    while (reader->next == reader->block.count) {
+        if (!read_block(reader)) {
+            return false;
+        }
+    }
+    *ring = reader->block.ring;
+    *record = reader->records[reader->next++];
+    return true;
+}
+
+void trace_close(struct trace_reader* reader) {
+    if (!reader) {
+        return;
+    }
+    fclose(reader->file);
+    for (uint32_t n = 0; n < TRACE_MAX_RINGS; ++n) {
+        free(reader->history[n]);
+    }
+    free(reader);
+}
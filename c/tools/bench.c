@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "batch.h"
+#include "cpu.h"
+#include "hash.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// the same pseudo random key presses for instance n in both runs
+static uint16_t keys_for(uint32_t instance, uint32_t frame) {
+    const uint64_t h = hash_mix(((uint64_t)instance << 32U) | (frame / 8));
+    return h & 1U ? (uint16_t)(1U << ((h >> 1U) & 0xFU)) : 0;
+}
+
+static void usage(void) {
+    printf("usage: chip8-bench [options] rom\n"
+           "  --instances N   instances to run (default 256)\n"
+           "  --frames N      frames per instance (default 600)\n"
+           "  --cycles N      instructions per frame (default 10)\n"
+           "  --mode MODE     chip8, schip or xochip (default chip8)\n\n");
+}
+
+static struct cpu** create_all(struct cpu_pool* pool, const struct rom* rom,
+                               uint32_t count, uint32_t cycles, uint8_t mode) {
+    struct cpu** cpus = calloc(count, sizeof(struct cpu*));
+    if (!cpus) {
+        fputs("Memory error", stderr);
+        return NULL;
+    }
+    for (uint32_t n = 0; n < count; ++n) {
+        cpus[n] = cpu_create(pool);
+        if (!cpus[n]) {
+            return cpus;
+        }
+        cpu_set_mode(cpus[n], mode);
+        if (!cpu_load_application(cpus[n], rom)) {
+            cpu_destroy(cpus[n]);
+            cpus[n] = NULL;
+            return cpus;
+        }
+        cpu_seed(cpus[n], n + 1);
+        cpu_set_clock(cpus[n], cycles * 60);
+    }
+    return cpus;
+}
+
+static void destroy_all(struct cpu** cpus, uint32_t count) {
+    for (uint32_t n = 0; cpus && n < count; ++n) {
+        cpu_destroy(cpus[n]);
+    }
+    free(cpus);
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t instances = 256;
+    uint32_t frames = 600;
+    uint32_t cycles = 10;
+    const char* filename = NULL;
+    uint8_t mode = CPU_CHIP8;
+
+    for (int32_t n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        const char* value = n + 1 < argc ? argv[n + 1] : NULL;
+        if (arg[0] != '-') {
+            filename = arg;
+            continue;
+        }
+        if (!value) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        n++;
+
+        if (strcmp(arg, "--instances") == 0) {
+            instances = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--frames") == 0) {
+            frames = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--cycles") == 0) {
+            cycles = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--mode") == 0) {
+            mode = cpu_mode_from_name(value);
+            if (mode == CPU_MODES) {
+                usage();
+                return EXIT_FAILURE;
+            }
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (!filename || instances == 0) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    struct rom* rom = rom_load(filename);
+    if (!rom) {
+        return EXIT_FAILURE;
+    }
+    struct cpu_pool pool;
+    if (cpu_pool_init(&pool, 64) != 0) {
+        rom_destroy(rom);
+        return EXIT_FAILURE;
+    }
+    struct cpu** scalar = create_all(&pool, rom, instances, cycles, mode);
+    struct cpu** batched = create_all(&pool, rom, instances, cycles, mode);
+    const uint32_t batch_count = (instances + BATCH_LANES - 1) / BATCH_LANES;
+    struct batch* batches = NULL;
+    if (posix_memalign((void**)&batches, _Alignof(struct batch),
+                       batch_count * sizeof(struct batch)) != 0) {
+        batches = NULL;
+    }
+    if (!scalar || !batched || !batches || !scalar[instances - 1] ||
+        !batched[instances - 1]) {
+        fputs("Memory error", stderr);
+        free(batches);
+        destroy_all(batched, instances);
+        destroy_all(scalar, instances);
+        cpu_pool_destroy(&pool);
+        rom_destroy(rom);
+        return EXIT_FAILURE;
+    }
+
+    double start = now();
+    for (uint32_t n = 0; n < instances; ++n) {
+        struct cpu* cpu = scalar[n];
+        for (uint32_t frame = 0; frame < frames; ++frame) {
+            cpu->key = keys_for(n, frame);
+            for (uint32_t c = 0; c < cycles; ++c) {
+                cpu_emulate_cycle(cpu);
+            }
+        }
+    }
+    const double scalar_seconds = now() - start;
+
+    start = now();
+    for (uint32_t b = 0; b < batch_count; ++b) {
+        const uint32_t first = b * BATCH_LANES;
+        const uint32_t lanes = instances - first < BATCH_LANES
+                                   ? instances - first
+                                   : BATCH_LANES;
+        batch_init(&batches[b], &batched[first], lanes);
+        for (uint32_t frame = 0; frame < frames; ++frame) {
+            for (uint32_t n = 0; n < lanes; ++n) {
+                batched[first + n]->key = keys_for(first + n, frame);
+            }
+            batch_run(&batches[b], cycles);
+        }
+        batch_sync(&batches[b]);
+    }
+    const double batch_seconds = now() - start;
+
+    uint64_t vector_cycles = 0;
+    uint64_t scalar_cycles = 0;
+    for (uint32_t b = 0; b < batch_count; ++b) {
+        vector_cycles += batches[b].vector_cycles;
+        scalar_cycles += batches[b].scalar_cycles;
+    }
+
+    uint32_t mismatches = 0;
+    for (uint32_t n = 0; n < instances; ++n) {
+        if (cpu_state_hash(scalar[n]) != cpu_state_hash(batched[n])) {
+            if (mismatches++ < 8) {
+                printf("instance %u differs: pc %04X vs %04X\n", n,
+                       scalar[n]->pc, batched[n]->pc);
+            }
+        }
+    }
+
+    const double total = (double)instances * frames * cycles;
+    printf("scalar  %8.1f M instructions/s\n",
+           total / scalar_seconds / 1e6);
+    printf("batched %8.1f M instructions/s, %.1f%% vectorised\n",
+           total / batch_seconds / 1e6,
+           100.0 * (double)vector_cycles /
+               (double)(vector_cycles + scalar_cycles));
+    printf("%u of %u instances differ\n", mismatches, instances);
+
+    free(batches);
+    destroy_all(batched, instances);
+    destroy_all(scalar, instances);
+    cpu_pool_destroy(&pool);
+    rom_destroy(rom);
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
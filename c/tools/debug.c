@@ -0,0 +1,470 @@
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "debug.h"
+#include "disasm.h"
+
+#define MAX_LINE 256
+// frames between checks for input that interrupts a continue
+#define INTERRUPT_FRAMES 60
+
+struct session {
+    struct cpu* cpu;
+    struct debugger debugger;
+    uint32_t ipf;
+    FILE* in;
+    FILE* out;
+    // a terminal or socket client, whose input can interrupt a continue.
+    // a script's input is always readable, so it never does.
+    bool interactive;
+};
+
+static void usage(void) {
+    printf("usage: chip8-debug [options] rom\n"
+           "  --ipf N           instructions per frame (default 10)\n"
+           "  --socket PATH     take commands on a Unix socket instead of "
+           "stdin\n"
+           "  --mode MODE       chip8, schip or xochip (default chip8)\n\n");
+}
+
+static void help(FILE* out) {
+    fprintf(out,
+            "break ADDR [if COND]            stop before ADDR runs\n"
+            "watch LO[-HI] [r|w|rw] [if COND] stop before FX33, FX55, FX65 "
+            "or DXYN\n"
+            "                                touch LO-HI (default rw)\n"
+            "delete ID                       remove a point\n"
+            "list                            show the points\n"
+            "step [N]                        run N instructions (default 1)\n"
+            "continue [FRAMES]               run until a point hits, any "
+            "input\n"
+            "                                interrupts\n"
+            "regs                            show the registers\n"
+            "mem ADDR [LEN]                  dump RAM\n"
+            "dis [ADDR] [N]                  disassemble (default at pc)\n"
+            "screen                          show the display\n"
+            "keys MASK                       hold the keys in the hex mask\n"
+            "set REG VALUE                   set V0-VF, I or PC\n"
+            "quit\n"
+            "COND is e.g. V3 == 5 && [0x300] > VA, see debug.h\n");
+}
+
+static uint16_t fetch(const struct cpu* cpu, uint16_t addr) {
+    return (uint16_t)(cpu_peek(cpu, addr) << 8U | cpu_peek(cpu, addr + 1));
+}
+
+static void print_instruction(const struct session* s, uint16_t addr) {
+    char text[32];
+    const uint16_t opcode = fetch(s->cpu, addr);
+    disasm_opcode(opcode, text, sizeof(text));
+    fprintf(s->out, "%s%04X  %04X  %s\n", addr == s->cpu->pc ? "> " : "  ",
+            addr & s->cpu->memory_mask, opcode, text);
+}
+
+static void print_regs(const struct session* s) {
+    const struct cpu* cpu = s->cpu;
+    fprintf(s->out, "pc %04X i %04X sp %X dt %02X st %02X keys %04X "
+                    "cycles %llu\n",
+            cpu->pc, cpu->i, cpu->sp, cpu_dt(cpu), cpu_st(cpu), cpu->key,
+            (unsigned long long)cpu->cycles);
+    for (uint32_t n = 0; n < 16; ++n) {
+        fprintf(s->out, "V%X %02X%s", n, cpu->v[n], n % 8 == 7 ? "\n" : "  ");
+    }
+}
+
+static void print_stop(struct session* s) {
+    if (s->debugger.stopped >= 0) {
+        fprintf(s->out, "stopped by ");
+        debug_print_point(&s->debugger, s->debugger.stopped, s->out);
+    }
+    print_instruction(s, s->cpu->pc);
+}
+
+static bool input_pending(const struct session* s) {
+    if (!s->interactive) {
+        return false;
+    }
+    // interactive input is unbuffered, see repl, so poll sees all of it.
+    // a client that hung up has nothing more to say
+    struct pollfd fd = {.fd = fileno(s->in), .events = POLLIN};
+    return poll(&fd, 1, 0) > 0 && !(fd.revents & (POLLHUP | POLLERR)) &&
+           (fd.revents & POLLIN);
+}
+
+// runs up to cycles instructions, through the debugger only while it has
+// points so that a session without any runs at full speed
+static uint64_t run(struct session* s, uint64_t cycles) {
+    struct debugger* debugger = &s->debugger;
+    if (debugger->active) {
+        uint64_t ran = 0;
+        while (ran < cycles && debugger->stopped < 0) {
+            const uint32_t chunk =
+                cycles - ran < s->ipf ? (uint32_t)(cycles - ran) : s->ipf;
+            ran += debug_run(debugger, s->cpu, chunk);
+        }
+        return ran;
+    }
+    for (uint64_t n = 0; n < cycles; ++n) {
+        cpu_emulate_cycle(s->cpu);
+    }
+    debugger->resume = false;
+    return cycles;
+}
+
+static void cont(struct session* s, uint64_t frames) {
+    s->debugger.stopped = -1;
+    for (uint64_t frame = 0; !frames || frame < frames; ++frame) {
+        run(s, s->ipf);
+        if (s->debugger.stopped >= 0) {
+            break;
+        }
+        if (frame % INTERRUPT_FRAMES == INTERRUPT_FRAMES - 1 &&
+            input_pending(s)) {
+            fprintf(s->out, "interrupted\n");
+            break;
+        }
+    }
+    print_stop(s);
+}
+
+static void step(struct session* s, uint64_t count) {
+    s->debugger.stopped = -1;
+    // a point on the way stops the step like a continue
+    for (uint64_t n = 0; n < count && s->debugger.stopped < 0; ++n) {
+        run(s, 1);
+    }
+    print_stop(s);
+}
+
+static bool parse_range(const char* text, uint16_t* lo, uint16_t* hi) {
+    char* end = NULL;
+    *lo = (uint16_t)(strtoul(text, &end, 16) & MEMORY_MAX_MASK);
+    if (end == text) {
+        return false;
+    }
+    *hi = *lo;
+    if (*end == '-') {
+        const char* start = end + 1;
+        *hi = (uint16_t)(strtoul(start, &end, 16) & MEMORY_MAX_MASK);
+        if (end == start) {
+            return false;
+        }
+    }
+    return *end == '\0';
+}
+
+// adds a point from the words after break or watch, the rest of the line
+// after "if" is the condition
+static void add_point(struct session* s, uint8_t kind, char* args) {
+    struct debug_point point = {.kind = kind};
+    char* condition = strstr(args, " if ");
+    if (condition) {
+        *condition = '\0';
+        condition += 4;
+    } else if (strncmp(args, "if ", 3) == 0) {
+        fprintf(s->out, "missing address\n");
+        return;
+    }
+
+    const char* range = strtok(args, " \t");
+    const char* mode = strtok(NULL, " \t");
+    if (!range || !parse_range(range, &point.lo, &point.hi)) {
+        fprintf(s->out, "bad address\n");
+        return;
+    }
+    if (kind != DEBUG_BREAK && mode) {
+        if (strcmp(mode, "r") == 0) {
+            point.kind = DEBUG_READ;
+        } else if (strcmp(mode, "w") == 0) {
+            point.kind = DEBUG_WRITE;
+        } else if (strcmp(mode, "rw") != 0) {
+            fprintf(s->out, "mode is r, w or rw\n");
+            return;
+        }
+    }
+    if (condition) {
+        if (!debug_parse_condition(condition, &point.condition)) {
+            fprintf(s->out, "bad condition\n");
+            return;
+        }
+        snprintf(point.text, sizeof(point.text), "%s", condition);
+    }
+
+    const int32_t id = debug_add(&s->debugger, &point);
+    if (id < 0) {
+        fprintf(s->out, "out of points\n");
+        return;
+    }
+    debug_print_point(&s->debugger, id, s->out);
+}
+
+static void set_register(struct session* s, const char* reg,
+                         const char* value) {
+    if (!reg || !value) {
+        fprintf(s->out, "usage: set REG VALUE\n");
+        return;
+    }
+    const uint32_t number = strtoul(value, NULL, 16);
+    if ((reg[0] == 'V' || reg[0] == 'v') && reg[1] && !reg[2]) {
+        char* end = NULL;
+        const unsigned long n = strtoul(reg + 1, &end, 16);
+        if (*end == '\0' && n < 16) {
+            s->cpu->v[n] = (uint8_t)number;
+            return;
+        }
+    } else if (strcasecmp(reg, "I") == 0) {
+        s->cpu->i = number & s->cpu->memory_mask;
+        return;
+    } else if (strcasecmp(reg, "PC") == 0) {
+        s->cpu->pc = number & s->cpu->memory_mask;
+        s->debugger.resume = false;
+        return;
+    }
+    fprintf(s->out, "unknown register %s\n", reg);
+}
+
+static void dump_memory(struct session* s, const char* addr, const char* len) {
+    if (!addr) {
+        fprintf(s->out, "usage: mem ADDR [LEN]\n");
+        return;
+    }
+    const uint16_t start = strtoul(addr, NULL, 16) & s->cpu->memory_mask;
+    const uint32_t count = len ? strtoul(len, NULL, 0) : 64;
+    for (uint32_t n = 0; n < count; ++n) {
+        if (n % 16 == 0) {
+            fprintf(s->out, "%s%04X ", n ? "\n" : "",
+                    (start + n) & s->cpu->memory_mask);
+        }
+        fprintf(s->out, " %02X", cpu_peek(s->cpu, start + n));
+    }
+    fprintf(s->out, "\n");
+}
+
+static void print_screen(const struct session* s) {
+    const struct display* display = s->cpu->display;
+    for (uint32_t y = 0; y < display->height; ++y) {
+        char row[DISPLAY_MAX_WIDTH + 1];
+        for (uint32_t x = 0; x < display->width; ++x) {
+            row[x] = DISPLAY_ASCII[display_pixel(display, x, y)];
+        }
+        row[display->width] = '\0';
+        fprintf(s->out, "%s\n", row);
+    }
+}
+
+// returns false on quit
+static bool command(struct session* s, char* line) {
+    line[strcspn(line, "\r\n")] = '\0';
+    char* args = line + strcspn(line, " \t");
+    if (*args) {
+        *args++ = '\0';
+        args += strspn(args, " \t");
+    }
+    char rest[MAX_LINE];
+    snprintf(rest, sizeof(rest), "%s", args);
+    const char* a = strtok(args, " \t");
+    const char* b = a ? strtok(NULL, " \t") : NULL;
+
+    if (line[0] == '\0') {
+        return true;
+    } else if (strcmp(line, "break") == 0 || strcmp(line, "b") == 0) {
+        add_point(s, DEBUG_BREAK, rest);
+    } else if (strcmp(line, "watch") == 0 || strcmp(line, "w") == 0) {
+        add_point(s, DEBUG_ACCESS, rest);
+    } else if (strcmp(line, "delete") == 0 || strcmp(line, "d") == 0) {
+        if (!a || !debug_delete(&s->debugger, (int32_t)strtol(a, NULL, 0))) {
+            fprintf(s->out, "no such point\n");
+        }
+    } else if (strcmp(line, "list") == 0 || strcmp(line, "l") == 0) {
+        for (uint32_t n = 0; n < s->debugger.count; ++n) {
+            if (s->debugger.points[n].kind != DEBUG_NONE) {
+                debug_print_point(&s->debugger, (int32_t)n, s->out);
+            }
+        }
+    } else if (strcmp(line, "step") == 0 || strcmp(line, "s") == 0) {
+        step(s, a ? strtoull(a, NULL, 0) : 1);
+    } else if (strcmp(line, "continue") == 0 || strcmp(line, "c") == 0) {
+        cont(s, a ? strtoull(a, NULL, 0) : 0);
+    } else if (strcmp(line, "regs") == 0 || strcmp(line, "r") == 0) {
+        print_regs(s);
+    } else if (strcmp(line, "mem") == 0 || strcmp(line, "m") == 0) {
+        dump_memory(s, a, b);
+    } else if (strcmp(line, "dis") == 0) {
+        const uint16_t mask = s->cpu->memory_mask;
+        uint16_t addr = a ? strtoul(a, NULL, 16) & mask : s->cpu->pc;
+        const uint32_t count = b ? strtoul(b, NULL, 0) : 8;
+        for (uint32_t n = 0; n < count; ++n, addr += 2) {
+            print_instruction(s, addr & mask);
+        }
+    } else if (strcmp(line, "screen") == 0) {
+        print_screen(s);
+    } else if (strcmp(line, "keys") == 0 && a) {
+        s->cpu->key = (uint16_t)strtoul(a, NULL, 16);
+    } else if (strcmp(line, "set") == 0) {
+        set_register(s, a, b);
+    } else if (strcmp(line, "quit") == 0 || strcmp(line, "q") == 0) {
+        return false;
+    } else {
+        help(s->out);
+    }
+    return true;
+}
+
+// reads commands until the input ends or says quit, returns false on quit
+static bool repl(struct session* s) {
+    char line[MAX_LINE];
+    // nothing may sit in the FILE's buffer where input_pending can't see it
+    if (s->interactive) {
+        setvbuf(s->in, NULL, _IONBF, 0);
+    }
+    while (true) {
+        fprintf(s->out, "(chip8) ");
+        fflush(s->out);
+        if (!fgets(line, sizeof(line), s->in)) {
+            return true;
+        }
+        if (!command(s, line)) {
+            return false;
+        }
+    }
+}
+
+static int32_t serve(struct session* s, const char* path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("Error: socket path too long\n");
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 ||
+        bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(listener, 1) != 0) {
+        printf("Error: failed to listen on %s\n", path);
+        if (listener >= 0) {
+            close(listener);
+        }
+        return EXIT_FAILURE;
+    }
+
+    // one client at a time, the session carries over between them
+    bool running = true;
+    while (running) {
+        const int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        const int out = dup(fd);
+        s->in = fdopen(fd, "r");
+        s->out = out >= 0 ? fdopen(out, "w") : NULL;
+        s->interactive = true;
+        if (!s->in || !s->out) {
+            fputs("Memory error", stderr);
+            running = false;
+        } else {
+            running = repl(s);
+        }
+        if (s->in) {
+            fclose(s->in);
+        } else {
+            close(fd);
+        }
+        if (s->out) {
+            fclose(s->out);
+        } else if (out >= 0) {
+            close(out);
+        }
+    }
+    close(listener);
+    unlink(path);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    const char* filename = NULL;
+    const char* socket_path = NULL;
+    uint32_t ipf = 10;
+    uint8_t mode = CPU_CHIP8;
+
+    for (int32_t n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        const char* value = n + 1 < argc ? argv[n + 1] : NULL;
+        if (arg[0] != '-') {
+            filename = arg;
+            continue;
+        }
+        if (!value) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        n++;
+
+        if (strcmp(arg, "--ipf") == 0) {
+            ipf = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--socket") == 0) {
+            socket_path = value;
+        } else if (strcmp(arg, "--mode") == 0) {
+            mode = cpu_mode_from_name(value);
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (!filename || ipf == 0 || mode == CPU_MODES) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    struct rom* rom = rom_load(filename);
+    if (!rom) {
+        printf("Failed to load chip8 application");
+        return EXIT_FAILURE;
+    }
+    struct cpu_pool pool;
+    if (cpu_pool_init(&pool, 1) != 0) {
+        rom_destroy(rom);
+        return EXIT_FAILURE;
+    }
+    struct session s = {
+        .cpu = cpu_create(&pool),
+        .ipf = ipf,
+        .in = stdin,
+        .out = stdout,
+        .interactive = isatty(fileno(stdin)),
+    };
+    if (!s.cpu) {
+        cpu_pool_destroy(&pool);
+        rom_destroy(rom);
+        return EXIT_FAILURE;
+    }
+    cpu_set_mode(s.cpu, mode);
+    if (!cpu_load_application(s.cpu, rom)) {
+        cpu_destroy(s.cpu);
+        cpu_pool_destroy(&pool);
+        rom_destroy(rom);
+        return EXIT_FAILURE;
+    }
+    cpu_seed(s.cpu, 1);
+    cpu_set_clock(s.cpu, ipf * 60);
+    debug_init(&s.debugger);
+
+    int32_t status = EXIT_SUCCESS;
+    if (socket_path) {
+        status = serve(&s, socket_path);
+    } else {
+        repl(&s);
+    }
+
+    cpu_destroy(s.cpu);
+    cpu_pool_destroy(&pool);
+    rom_destroy(rom);
+    return status;
+}
@@ -0,0 +1,418 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "disasm.h"
+#include "hash.h"
+#include "instr.h"
+#include "zigcore.h"
+
+/*
+runs the C and the Zig core in lockstep and compares them after every
+instruction. the comparison hashes the registers plus whatever the
+instruction may have written: the stored bytes for FX33/FX55 and the drawn
+rows for 00E0/DXYN. only on a mismatch are the full states diffed.
+
+CXNN draws from different generators in each core, so the Zig result is
+overwritten with the C one. instructions that would trap in the Zig core
+(12bit overflow, out of range indexing) end the run, since C silently wraps
+them; --strict reports them like divergences.
+
+nothing is allocated per instruction or per random stream.
+*/
+
+struct harness {
+    struct cpu_pool pool;
+    struct cpu* cpu;
+    struct zig_core* zig;
+    uint32_t ipf;
+    uint64_t instructions;
+    uint64_t divergences;
+};
+
+// the C core state in the Zig layout
+static void c_state(const struct cpu* cpu, struct zig_state* out) {
+    memset(out, 0, sizeof(*out));
+    memcpy(out->v, cpu->v, sizeof(out->v));
+    memcpy(out->stack, cpu->stack, sizeof(out->stack));
+    out->i = cpu->i;
+    out->pc = cpu->pc;
+    out->sp = cpu->sp;
+    out->dt = cpu_dt(cpu);
+    out->st = cpu_st(cpu);
+}
+
+// why the Zig core would trap on the instruction at its pc, or NULL
+static const char* zig_trap(const struct zig_state* z, uint16_t opcode) {
+    union instr instr = {.instr = opcode};
+    if (z->pc >= MEMORY_SIZE - 4) {
+        return "pc overflows 12 bits";
+    }
+    switch (instr.opcode) {
+    case 0x0:
+        if (instr.nn == 0xEE && z->sp == 0) {
+            return "return with empty stack";
+        }
+        break;
+    case 0x2:
+        if (z->sp >= 16) {
+            return "call with full stack";
+        }
+        break;
+    case 0xB:
+        if (instr.nnn + z->v[0] > MEMORY_MASK) {
+            return "jump target overflows 12 bits";
+        }
+        break;
+    case 0xD:
+        if (z->i + instr.n > MEMORY_SIZE) {
+            return "sprite read past end of memory";
+        }
+        break;
+    case 0xE:
+        if (z->v[instr.x] > 0xF) {
+            return "key index out of range";
+        }
+        break;
+    case 0xF:
+        if (instr.nn == 0x33 && z->i + 2 > MEMORY_MASK) {
+            return "BCD store past end of memory";
+        }
+        if ((instr.nn == 0x55 || instr.nn == 0x65) &&
+            z->i + instr.x > MEMORY_MASK) {
+            return "register store past end of memory";
+        }
+        break;
+    }
+    return NULL;
+}
+
+// what an instruction may write besides registers, captured before it runs
+struct touch {
+    union instr instr;
+    uint16_t i;
+    uint8_t vy;
+};
+
+// a CHIP-8 row as the Zig core stores it
+static uint64_t c_row(const struct cpu* cpu, uint32_t y) {
+    return (uint64_t)(cpu->display->rows[0][y] >> 64U);
+}
+
+static uint64_t c_hash(const struct cpu* cpu, struct touch touch,
+                       const struct zig_state* state) {
+    const union instr instr = touch.instr;
+    uint64_t h = hash_bytes(state, sizeof(*state), 0);
+    if (instr.opcode == 0xF && (instr.nn == 0x33 || instr.nn == 0x55)) {
+        const uint16_t len = instr.nn == 0x33 ? 3 : instr.x + 1;
+        for (uint16_t n = 0; n < len; ++n) {
+            h = hash_mix(h ^ cpu_peek(cpu, touch.i + n));
+        }
+    } else if (instr.instr == 0x00E0) {
+        uint64_t rows[SCREEN_HEIGHT];
+        for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y) {
+            rows[y] = c_row(cpu, y);
+        }
+        h = hash_bytes(rows, sizeof(rows), h);
+    } else if (instr.opcode == 0xD) {
+        for (uint32_t n = 0; n < instr.n; ++n) {
+            h = hash_mix(h ^ c_row(cpu, (touch.vy + n) % SCREEN_HEIGHT));
+        }
+    }
+    return h;
+}
+
+static uint64_t zig_hash(const struct zig_core* zig, struct touch touch,
+                         const struct zig_state* state) {
+    const union instr instr = touch.instr;
+    uint64_t h = hash_bytes(state, sizeof(*state), 0);
+    if (instr.opcode == 0xF && (instr.nn == 0x33 || instr.nn == 0x55)) {
+        const uint8_t* mem = chip8_zig_mem(zig);
+        const uint16_t len = instr.nn == 0x33 ? 3 : instr.x + 1;
+        for (uint16_t n = 0; n < len; ++n) {
+            h = hash_mix(h ^ mem[(touch.i + n) & MEMORY_MASK]);
+        }
+    } else if (instr.instr == 0x00E0) {
+        uint64_t rows[SCREEN_HEIGHT];
+        for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y) {
+            rows[y] = chip8_zig_row(zig, y);
+        }
+        h = hash_bytes(rows, sizeof(rows), h);
+    } else if (instr.opcode == 0xD) {
+        for (uint32_t n = 0; n < instr.n; ++n) {
+            h = hash_mix(h ^ chip8_zig_row(zig, (touch.vy + n) % SCREEN_HEIGHT));
+        }
+    }
+    return h;
+}
+
+static void report(const char* name, uint64_t count, uint16_t pc,
+                   uint16_t opcode, const struct cpu* cpu,
+                   const struct zig_core* zig, const char* reason) {
+    char text[32];
+    disasm_opcode(opcode, text, sizeof(text));
+    printf("%s: diverged at instruction %" PRIu64 ", 0x%03X: %04X  %s\n", name,
+           count, pc, opcode, text);
+    if (reason) {
+        printf("  zig: %s\n", reason);
+        return;
+    }
+
+    struct zig_state c;
+    struct zig_state z;
+    c_state(cpu, &c);
+    chip8_zig_state(zig, &z);
+    for (uint32_t n = 0; n < 16; ++n) {
+        if (c.v[n] != z.v[n]) {
+            printf("  V%X: c=0x%02X zig=0x%02X\n", n, c.v[n], z.v[n]);
+        }
+    }
+    for (uint32_t n = 0; n < 16; ++n) {
+        if (c.stack[n] != z.stack[n]) {
+            printf("  stack[%u]: c=0x%03X zig=0x%03X\n", n, c.stack[n],
+                   z.stack[n]);
+        }
+    }
+    if (c.i != z.i) {
+        printf("  I: c=0x%03X zig=0x%03X\n", c.i, z.i);
+    }
+    if (c.pc != z.pc) {
+        printf("  PC: c=0x%03X zig=0x%03X\n", c.pc, z.pc);
+    }
+    if (c.sp != z.sp) {
+        printf("  SP: c=%u zig=%u\n", c.sp, z.sp);
+    }
+    if (c.dt != z.dt) {
+        printf("  DT: c=%u zig=%u\n", c.dt, z.dt);
+    }
+    if (c.st != z.st) {
+        printf("  ST: c=%u zig=%u\n", c.st, z.st);
+    }
+
+    const uint8_t* mem = chip8_zig_mem(zig);
+    for (uint32_t addr = 0; addr < MEMORY_SIZE; ++addr) {
+        if (cpu_peek(cpu, addr) != mem[addr]) {
+            printf("  [0x%03X]: c=0x%02X zig=0x%02X\n", addr,
+                   cpu_peek(cpu, addr), mem[addr]);
+        }
+    }
+    for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y) {
+        const uint64_t row = chip8_zig_row(zig, y);
+        if (c_row(cpu, y) != row) {
+            printf("  row %2u: c=%016" PRIX64 " zig=%016" PRIX64 "\n", y,
+                   c_row(cpu, y), row);
+        }
+    }
+}
+
+enum outcome {
+    OUTCOME_MATCH,
+    OUTCOME_DIVERGED,
+    OUTCOME_TRAPPED,
+};
+
+static enum outcome run(struct harness* h, const char* name,
+                        const struct rom* rom, uint64_t limit, bool strict) {
+    // recycled through the pool, so this doesn't hit malloc either
+    cpu_destroy(h->cpu);
+    struct cpu* cpu = h->cpu = cpu_create(&h->pool);
+    if (!cpu) {
+        fputs("Memory error", stderr);
+        return OUTCOME_DIVERGED;
+    }
+    if (!cpu_load_application(cpu, rom)) {
+        printf("%s: too big for CHIP-8\n", name);
+        return OUTCOME_DIVERGED;
+    }
+    cpu_seed(cpu, 1);
+    cpu_set_clock(cpu, h->ipf * 60);
+    if (!chip8_zig_load(h->zig, rom->data, rom->size)) {
+        printf("%s: rejected by the Zig core\n", name);
+        return OUTCOME_DIVERGED;
+    }
+
+    struct zig_state c;
+    struct zig_state z;
+    chip8_zig_state(h->zig, &z);
+
+    uint64_t count = 0;
+    enum outcome outcome = OUTCOME_MATCH;
+    for (; count < limit; ++count) {
+        const uint16_t pc = cpu->pc;
+        const uint16_t opcode =
+            (uint16_t)(cpu_peek(cpu, pc) << 8U | cpu_peek(cpu, pc + 1));
+        const union instr instr = {.instr = opcode};
+        const struct touch touch = {
+            .instr = instr,
+            .i = cpu->i,
+            .vy = cpu->v[instr.y],
+        };
+
+        const char* trap = zig_trap(&z, opcode);
+        if (trap) {
+            if (strict) {
+                report(name, count, pc, opcode, cpu, h->zig, trap);
+            }
+            outcome = OUTCOME_TRAPPED;
+            break;
+        }
+
+        cpu_emulate_cycle(cpu);
+        chip8_zig_step(h->zig);
+        if (instr.opcode == 0xC) {
+            chip8_zig_set_v(h->zig, instr.x, cpu->v[instr.x]);
+        }
+        // the C timers follow from the cycle count, see cpu_set_clock
+        if ((count + 1) % h->ipf == 0) {
+            chip8_zig_tick(h->zig);
+        }
+
+        c_state(cpu, &c);
+        chip8_zig_state(h->zig, &z);
+        if (c_hash(cpu, touch, &c) != zig_hash(h->zig, touch, &z)) {
+            report(name, count, pc, opcode, cpu, h->zig, NULL);
+            outcome = OUTCOME_DIVERGED;
+            break;
+        }
+    }
+
+    h->instructions += count;
+    return outcome;
+}
+
+static uint64_t next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13U;
+    x ^= x >> 7U;
+    x ^= x << 17U;
+    *state = x;
+    return x;
+}
+
+// every opcode both cores implement, as fixed bits plus random bits
+static const uint16_t opcode_templates[][2] = {
+    {0x00E0, 0x0000}, {0x00EE, 0x0000}, {0x1000, 0x0FFF}, {0x2000, 0x0FFF},
+    {0x3000, 0x0FFF}, {0x4000, 0x0FFF}, {0x5000, 0x0FF0}, {0x6000, 0x0FFF},
+    {0x7000, 0x0FFF}, {0x8000, 0x0FF0}, {0x8001, 0x0FF0}, {0x8002, 0x0FF0},
+    {0x8003, 0x0FF0}, {0x8004, 0x0FF0}, {0x8005, 0x0FF0}, {0x8006, 0x0FF0},
+    {0x8007, 0x0FF0}, {0x800E, 0x0FF0}, {0x9000, 0x0FF0}, {0xA000, 0x0FFF},
+    {0xB000, 0x0FFF}, {0xC000, 0x0FFF}, {0xD000, 0x0FFF}, {0xE09E, 0x0F00},
+    {0xE0A1, 0x0F00}, {0xF007, 0x0F00}, {0xF00A, 0x0F00}, {0xF015, 0x0F00},
+    {0xF018, 0x0F00}, {0xF01E, 0x0F00}, {0xF029, 0x0F00}, {0xF033, 0x0F00},
+    {0xF055, 0x0F00}, {0xF065, 0x0F00},
+};
+
+static void random_rom(uint8_t* data, size_t size, uint64_t* state) {
+    const size_t templates =
+        sizeof(opcode_templates) / sizeof(opcode_templates[0]);
+    for (size_t n = 0; n + 1 < size; n += 2) {
+        const uint64_t r = next_random(state);
+        const uint16_t* t = opcode_templates[r % templates];
+        uint16_t opcode = t[0] | ((uint16_t)(r >> 16U) & t[1]);
+        if (t[0] == 0x1000 || t[0] == 0x2000 || t[0] == 0xB000) {
+            // keep control flow inside the program area
+            opcode = t[0] | ((APP_MEMORY_OFFSET +
+                              (r >> 16U) % (MEMORY_SIZE - APP_MEMORY_OFFSET)) &
+                             0xFFEU);
+        }
+        data[n] = opcode >> 8U;
+        data[n + 1] = opcode & 0xFFU;
+    }
+}
+
+static void usage(void) {
+    printf("usage: chip8-difftest [options] [rom...]\n"
+           "  --random N     also run N random instruction streams\n"
+           "  --length N     instructions per ROM or stream (default 1000000)\n"
+           "  --seed N       seed for the random streams\n"
+           "  --ipf N        instructions per timer tick (default 10)\n"
+           "  --strict       report instructions the Zig core would trap on\n\n");
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t streams = 0;
+    uint64_t length = 1000000;
+    uint64_t seed = 0x853C49E6748FEA9BULL;
+    uint32_t ipf = 10;
+    bool strict = false;
+
+    int32_t first_rom = argc;
+    for (int32_t n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        if (arg[0] != '-') {
+            first_rom = n;
+            break;
+        }
+        if (strcmp(arg, "--strict") == 0) {
+            strict = true;
+            continue;
+        }
+        if (n + 1 >= argc) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        const uint64_t value = strtoull(argv[++n], NULL, 0);
+        if (strcmp(arg, "--random") == 0) {
+            streams = value;
+        } else if (strcmp(arg, "--length") == 0) {
+            length = value;
+        } else if (strcmp(arg, "--seed") == 0) {
+            seed = value ? value : 1;
+        } else if (strcmp(arg, "--ipf") == 0) {
+            ipf = value ? (uint32_t)value : 1;
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (first_rom == argc && streams == 0) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    struct harness h = {.ipf = ipf};
+    if (cpu_pool_init(&h.pool, 1) != 0) {
+        return EXIT_FAILURE;
+    }
+    h.cpu = cpu_create(&h.pool);
+    h.zig = chip8_zig_create(seed);
+    if (!h.cpu || !h.zig) {
+        fputs("Memory error", stderr);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t trapped = 0;
+    for (int32_t n = first_rom; n < argc; ++n) {
+        struct rom* rom = rom_load(argv[n]);
+        if (!rom) {
+            h.divergences++;
+            continue;
+        }
+        const enum outcome outcome = run(&h, argv[n], rom, length, strict);
+        h.divergences += outcome == OUTCOME_DIVERGED;
+        trapped += outcome == OUTCOME_TRAPPED;
+        rom_destroy(rom);
+    }
+
+    uint8_t data[MEMORY_SIZE - APP_MEMORY_OFFSET];
+    struct rom stream = {.data = data, .size = sizeof(data)};
+    char name[32];
+    for (uint64_t n = 0; n < streams; ++n) {
+        random_rom(data, sizeof(data), &seed);
+        snprintf(name, sizeof(name), "stream %" PRIu64, n);
+        const enum outcome outcome = run(&h, name, &stream, length, strict);
+        h.divergences += outcome == OUTCOME_DIVERGED;
+        trapped += outcome == OUTCOME_TRAPPED;
+    }
+
+    printf("%" PRIu64 " instructions checked, %" PRIu64
+           " divergences, %" PRIu64 " runs stopped at a Zig trap\n",
+           h.instructions, h.divergences, trapped);
+
+    chip8_zig_destroy(h.zig);
+    cpu_destroy(h.cpu);
+    cpu_pool_destroy(&h.pool);
+    return h.divergences == 0 && (!strict || trapped == 0) ? EXIT_SUCCESS
+                                                            : EXIT_FAILURE;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "explore.h"
+
+#define MAX_PIXELS 64
+
+struct goal {
+    int32_t ram_addr;
+    uint8_t ram_value;
+    uint32_t pixel_count;
+    uint8_t pixels[MAX_PIXELS][2];
+    int32_t maximize_addr;
+};
+
+static bool reached(const struct cpu* cpu, void* user) {
+    const struct goal* goal = user;
+    if (goal->ram_addr >= 0 &&
+        cpu_peek(cpu, (uint16_t)goal->ram_addr) != goal->ram_value) {
+        return false;
+    }
+    const struct display* display = cpu->display;
+    for (uint32_t n = 0; n < goal->pixel_count; ++n) {
+        const uint32_t x = goal->pixels[n][0];
+        const uint32_t y = goal->pixels[n][1];
+        // pixels beyond a lores screen only light up in hires mode
+        if (x >= display->width || y >= display->height ||
+            !display_pixel(display, x, y)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int32_t score(const struct cpu* cpu, void* user) {
+    const struct goal* goal = user;
+    return cpu_peek(cpu, (uint16_t)goal->maximize_addr);
+}
+
+static void usage(void) {
+    printf("usage: chip8-explore [options] rom\n"
+           "  --ram ADDR=VALUE   stop once the RAM byte at ADDR equals VALUE\n"
+           "  --pixel X,Y        stop once pixel X,Y is lit (repeatable)\n"
+           "  --maximize ADDR    best first search on the RAM byte at ADDR\n"
+           "  --threads N        worker threads (default: all cores)\n"
+           "  --cycles N         instructions per frame (default 10)\n"
+           "  --depth N          maximum frames per input sequence\n"
+           "  --states N         visited set capacity (default 1000000)\n"
+           "  --keys MASK        keys to branch on, hex (default FFFF)\n"
+           "  --mode MODE        chip8, schip or xochip (default chip8)\n\n");
+}
+
+int main(int argc, char* argv[]) {
+    struct goal goal = {.ram_addr = -1, .maximize_addr = -1};
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    struct explore_config config = {
+        .threads = cores > 0 ? (uint32_t)cores : 1,
+        .cycles_per_frame = 10,
+        .max_depth = 600,
+        .max_states = 1000000,
+        .inputs = EXPLORE_ALL_INPUTS,
+        .goal = reached,
+        .user = &goal,
+    };
+    const char* filename = NULL;
+    uint8_t mode = CPU_CHIP8;
+
+    for (int32_t n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        const char* value = n + 1 < argc ? argv[n + 1] : NULL;
+        if (arg[0] != '-') {
+            filename = arg;
+            continue;
+        }
+        if (!value) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        n++;
+
+        if (strcmp(arg, "--ram") == 0) {
+            int addr = 0;
+            int byte = 0;
+            if (sscanf(value, "%i=%i", &addr, &byte) != 2) {
+                usage();
+                return EXIT_FAILURE;
+            }
+            goal.ram_addr = addr & MEMORY_MAX_MASK;
+            goal.ram_value = (uint8_t)byte;
+        } else if (strcmp(arg, "--pixel") == 0) {
+            int x = 0;
+            int y = 0;
+            if (goal.pixel_count == MAX_PIXELS ||
+                sscanf(value, "%i,%i", &x, &y) != 2) {
+                usage();
+                return EXIT_FAILURE;
+            }
+            goal.pixels[goal.pixel_count][0] = x % DISPLAY_MAX_WIDTH;
+            goal.pixels[goal.pixel_count][1] = y % DISPLAY_MAX_HEIGHT;
+            goal.pixel_count++;
+        } else if (strcmp(arg, "--maximize") == 0) {
+            goal.maximize_addr =
+                (int32_t)(strtol(value, NULL, 0) & MEMORY_MAX_MASK);
+            config.score = score;
+        } else if (strcmp(arg, "--threads") == 0) {
+            config.threads = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--cycles") == 0) {
+            config.cycles_per_frame = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--depth") == 0) {
+            config.max_depth = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--states") == 0) {
+            config.max_states = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--keys") == 0) {
+            config.inputs = (strtoul(value, NULL, 16) & 0xFFFFU) |
+                            (1U << EXPLORE_NO_KEY);
+        } else if (strcmp(arg, "--mode") == 0) {
+            mode = cpu_mode_from_name(value);
+            if (mode == CPU_MODES) {
+                usage();
+                return EXIT_FAILURE;
+            }
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!filename || config.threads == 0 ||
+        (goal.ram_addr < 0 && goal.pixel_count == 0)) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    struct rom* rom = rom_load(filename);
+    if (!rom) {
+        return EXIT_FAILURE;
+    }
+    struct cpu_pool pool;
+    if (cpu_pool_init(&pool, 1) != 0) {
+        rom_destroy(rom);
+        return EXIT_FAILURE;
+    }
+    struct cpu* cpu = cpu_create(&pool);
+    if (!cpu) {
+        cpu_pool_destroy(&pool);
+        rom_destroy(rom);
+        return EXIT_FAILURE;
+    }
+    cpu_set_mode(cpu, mode);
+    if (!cpu_load_application(cpu, rom)) {
+        cpu_destroy(cpu);
+        cpu_pool_destroy(&pool);
+        rom_destroy(rom);
+        return EXIT_FAILURE;
+    }
+    cpu_seed(cpu, 1);
+
+    struct explore_result result;
+    int32_t status = explore_run(cpu, &config, &result);
+
+    printf("%llu frames, %llu states in %.3fs (%.0f frames/s)\n",
+           (unsigned long long)result.frames,
+           (unsigned long long)result.states, result.seconds,
+           result.seconds > 0 ? (double)result.frames / result.seconds : 0.0);
+    if (result.found) {
+        printf("goal reached after %u frames:", result.depth);
+        for (uint32_t n = 0; n < result.depth; ++n) {
+            if (result.inputs[n] == EXPLORE_NO_KEY) {
+                printf(" -");
+            } else {
+                printf(" %X", result.inputs[n]);
+            }
+        }
+        printf("\n");
+    } else {
+        printf("goal not reached\n");
+    }
+    free(result.inputs);
+
+    cpu_destroy(cpu);
+    cpu_pool_destroy(&pool);
+    rom_destroy(rom);
+    return status == 0 && result.found ? EXIT_SUCCESS : EXIT_FAILURE;
+}
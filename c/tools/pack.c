@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "mem.h"
+#include "pack.h"
+
+static const char* const profile_names[] = {
+    [PACK_PROFILE_CHIP8] = "chip8",
+    [PACK_PROFILE_SCHIP] = "schip",
+    [PACK_PROFILE_XOCHIP] = "xochip",
+};
+
+#define PROFILE_COUNT (sizeof(profile_names) / sizeof(profile_names[0]))
+
+struct input {
+    const char* path;
+    const char* name;
+    struct pack_entry entry;
+};
+
+static void usage(void) {
+    printf("usage: chip8-pack build PACK [options] rom...\n"
+           "       chip8-pack list PACK\n"
+           "  --ipf N          instructions per frame of the following ROMs\n"
+           "  --profile NAME   quirk profile of the following ROMs: chip8,\n"
+           "                   schip or xochip\n"
+           "  --list FILE      add the ROMs listed in FILE, one per line\n\n");
+}
+
+static const char* base_name(const char* path) {
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static bool write_zeros(FILE* file, uint64_t count) {
+    static const uint8_t zeros[PAGE_SIZE];
+    while (count > 0) {
+        const size_t len = count < PAGE_SIZE ? count : PAGE_SIZE;
+        if (fwrite(zeros, 1, len, file) != len) {
+            return false;
+        }
+        count -= len;
+    }
+    return true;
+}
+
+// lays out header, entries, index and names, then streams the ROMs in
+static int32_t write_pack(const char* filename, struct input* inputs,
+                          uint32_t count) {
+    uint32_t slots = 2;
+    while (slots < count * 2) {
+        slots *= 2;
+    }
+    uint32_t* index = calloc(slots, sizeof(uint32_t));
+    if (!index) {
+        fputs("Memory error", stderr);
+        return EXIT_FAILURE;
+    }
+
+    struct pack_header header = {
+        .magic = PACK_MAGIC,
+        .version = PACK_VERSION,
+        .count = count,
+        .slots = slots,
+        .entries = sizeof(struct pack_header),
+    };
+    header.index = header.entries + (uint64_t)count * sizeof(struct pack_entry);
+    header.names = header.index + (uint64_t)slots * sizeof(uint32_t);
+
+    uint64_t names_size = 0;
+    for (uint32_t n = 0; n < count; ++n) {
+        struct pack_entry* entry = &inputs[n].entry;
+        entry->key = pack_key(inputs[n].name);
+        entry->name = (uint32_t)names_size;
+        names_size += strlen(inputs[n].name) + 1;
+
+        uint32_t slot = entry->key & (slots - 1);
+        for (; index[slot] != 0; slot = (slot + 1) & (slots - 1)) {
+            const struct input* other = &inputs[index[slot] - 1];
+            if (other->entry.key == entry->key &&
+                strcmp(other->name, inputs[n].name) == 0) {
+                printf("Error: %s is in the pack twice\n", inputs[n].name);
+                free(index);
+                return EXIT_FAILURE;
+            }
+        }
+        index[slot] = n + 1;
+    }
+
+    uint64_t offset =
+        (header.names + names_size + PAGE_MASK) & ~(uint64_t)PAGE_MASK;
+    const uint64_t data = offset;
+    for (uint32_t n = 0; n < count; ++n) {
+        inputs[n].entry.offset = offset;
+        offset += (inputs[n].entry.size + PAGE_MASK) & ~PAGE_MASK;
+    }
+    header.size = offset;
+
+    FILE* file = fopen(filename, "wbe");
+    if (!file) {
+        fputs("File error", stderr);
+        free(index);
+        return EXIT_FAILURE;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (uint32_t n = 0; ok && n < count; ++n) {
+        ok = fwrite(&inputs[n].entry, sizeof(struct pack_entry), 1, file) == 1;
+    }
+    ok = ok && fwrite(index, sizeof(uint32_t), slots, file) == slots;
+    for (uint32_t n = 0; ok && n < count; ++n) {
+        const size_t len = strlen(inputs[n].name) + 1;
+        ok = fwrite(inputs[n].name, 1, len, file) == len;
+    }
+    ok = ok && write_zeros(file, data - header.names - names_size);
+
+    for (uint32_t n = 0; ok && n < count; ++n) {
+        // rom_load pads with zeros exactly like the pack does
+        struct rom* rom = rom_load(inputs[n].path);
+        if (!rom || rom->size != inputs[n].entry.size) {
+            printf("Error: %s changed while packing\n", inputs[n].path);
+            rom_destroy(rom);
+            ok = false;
+            break;
+        }
+        const size_t padded = (rom->size + PAGE_MASK) & ~PAGE_MASK;
+        ok = fwrite(rom->data, 1, padded, file) == padded;
+        rom_destroy(rom);
+    }
+
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    free(index);
+    if (!ok) {
+        fputs("Writing error", stderr);
+        remove(filename);
+        return EXIT_FAILURE;
+    }
+    printf("packed %u ROMs, %llu bytes\n", count,
+           (unsigned long long)header.size);
+    return EXIT_SUCCESS;
+}
+
+struct inputs {
+    struct input* items;
+    uint32_t count;
+    uint32_t capacity;
+    // paths read from list files, owned here
+    char** paths;
+    uint32_t path_count;
+};
+
+static bool add_input(struct inputs* inputs, const char* path, uint16_t ipf,
+                      uint8_t profile) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        printf("Error: cannot read %s\n", path);
+        return false;
+    }
+    // only XO-CHIP has more than 4 KB of memory
+    const off_t memory =
+        profile == PACK_PROFILE_XOCHIP ? MEMORY_MAX_SIZE : MEMORY_SIZE;
+    if (st.st_size > memory - APP_MEMORY_OFFSET) {
+        printf("Error: %s is too big for memory\n", path);
+        return false;
+    }
+    if (inputs->count == inputs->capacity) {
+        const uint32_t capacity = inputs->capacity ? inputs->capacity * 2 : 64;
+        struct input* items =
+            realloc(inputs->items, capacity * sizeof(struct input));
+        if (!items) {
+            fputs("Memory error", stderr);
+            return false;
+        }
+        inputs->items = items;
+        inputs->capacity = capacity;
+    }
+    inputs->items[inputs->count++] = (struct input){
+        .path = path,
+        .name = base_name(path),
+        .entry =
+            {
+                .size = (uint32_t)st.st_size,
+                .ipf = ipf,
+                .profile = profile,
+            },
+    };
+    return true;
+}
+
+// one path per line, for more ROMs than fit on a command line
+static bool add_list(struct inputs* inputs, const char* filename,
+                     uint16_t ipf, uint8_t profile) {
+    FILE* file = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "re");
+    if (!file) {
+        fputs("File error", stderr);
+        return false;
+    }
+
+    bool ok = true;
+    char line[4096];
+    while (ok && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            continue;
+        }
+        char** paths =
+            realloc(inputs->paths, (inputs->path_count + 1) * sizeof(char*));
+        char* path = strdup(line);
+        if (paths) {
+            inputs->paths = paths;
+        }
+        if (!paths || !path) {
+            fputs("Memory error", stderr);
+            free(path);
+            ok = false;
+            break;
+        }
+        inputs->paths[inputs->path_count++] = path;
+        ok = add_input(inputs, path, ipf, profile);
+    }
+    if (file != stdin) {
+        fclose(file);
+    }
+    return ok;
+}
+
+static void free_inputs(struct inputs* inputs) {
+    for (uint32_t n = 0; n < inputs->path_count; ++n) {
+        free(inputs->paths[n]);
+    }
+    free(inputs->paths);
+    free(inputs->items);
+}
+
+static int32_t build(const char* filename, int32_t argc, char* argv[]) {
+    struct inputs inputs = {0};
+    uint16_t ipf = 0;
+    uint8_t profile = PACK_PROFILE_CHIP8;
+    bool ok = true;
+
+    for (int32_t n = 0; ok && n < argc; ++n) {
+        const char* arg = argv[n];
+        const char* value = n + 1 < argc ? argv[n + 1] : NULL;
+        if (arg[0] != '-') {
+            ok = add_input(&inputs, arg, ipf, profile);
+            continue;
+        }
+        if (!value) {
+            usage();
+            ok = false;
+            break;
+        }
+        n++;
+
+        if (strcmp(arg, "--ipf") == 0) {
+            ipf = (uint16_t)strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--profile") == 0) {
+            for (profile = 0; profile < PROFILE_COUNT; ++profile) {
+                if (strcmp(value, profile_names[profile]) == 0) {
+                    break;
+                }
+            }
+            if (profile == PROFILE_COUNT) {
+                usage();
+                ok = false;
+            }
+        } else if (strcmp(arg, "--list") == 0) {
+            ok = add_list(&inputs, value, ipf, profile);
+        } else {
+            usage();
+            ok = false;
+        }
+    }
+
+    int32_t status = ok ? write_pack(filename, inputs.items, inputs.count)
+                        : EXIT_FAILURE;
+    free_inputs(&inputs);
+    return status;
+}
+
+static int32_t list(const char* filename) {
+    struct pack* pack = pack_open(filename);
+    if (!pack) {
+        return EXIT_FAILURE;
+    }
+
+    int32_t status = EXIT_SUCCESS;
+    for (uint32_t n = 0; n < pack_count(pack); ++n) {
+        struct pack_rom rom;
+        if (!pack_get(pack, n, &rom)) {
+            status = EXIT_FAILURE;
+            continue;
+        }
+        printf("%-32s %5zu bytes  ipf %-4u %s\n", rom.name, rom.rom.size,
+               rom.ipf,
+               rom.profile < PROFILE_COUNT ? profile_names[rom.profile] : "?");
+    }
+    pack_close(pack);
+    return status;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 3 && strcmp(argv[1], "build") == 0) {
+        return build(argv[2], argc - 3, &argv[3]);
+    }
+    if (argc == 3 && strcmp(argv[1], "list") == 0) {
+        return list(argv[2]);
+    }
+    usage();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "display.h"
+#include "export.h"
+
+static void usage(void) {
+    printf("usage: chip8-peek [options] name\n"
+           "  --slot N     instance to show (default 0)\n"
+           "  --keys HEX   hold this key mask, bit n is key n\n"
+           "  --all        one line per instance instead of the screen\n\n");
+}
+
+static void print_state(uint32_t slot, const struct export_state* state) {
+    printf("#%u frame %llu pc %04X i %04X sp %X dt %02X st %02X keys %04X\n",
+           slot, (unsigned long long)state->frame, state->pc, state->i,
+           state->sp, state->dt, state->st, state->key);
+    for (uint32_t n = 0; n < 16; ++n) {
+        printf("V%X=%02X%c", n, state->v[n], n % 8 == 7 ? '\n' : ' ');
+    }
+    // the size comes from shared memory anyone can write, don't trust it
+    const struct display* display = &state->display;
+    const uint32_t width = display->width < DISPLAY_MAX_WIDTH
+                               ? display->width
+                               : DISPLAY_MAX_WIDTH;
+    const uint32_t height = display->height < DISPLAY_MAX_HEIGHT
+                                ? display->height
+                                : DISPLAY_MAX_HEIGHT;
+    for (uint32_t y = 0; y < height; ++y) {
+        char row[DISPLAY_MAX_WIDTH + 1];
+        for (uint32_t x = 0; x < width; ++x) {
+            row[x] = DISPLAY_ASCII[display_pixel(display, x, y)];
+        }
+        row[width] = '\0';
+        puts(row);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const char* name = NULL;
+    uint32_t slot = 0;
+    int64_t keys = -1;
+    bool all = false;
+
+    for (int32_t n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        const char* value = n + 1 < argc ? argv[n + 1] : NULL;
+        if (arg[0] != '-') {
+            name = arg;
+            continue;
+        }
+        if (strcmp(arg, "--all") == 0) {
+            all = true;
+            continue;
+        }
+        if (!value) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        n++;
+
+        if (strcmp(arg, "--slot") == 0) {
+            slot = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--keys") == 0) {
+            keys = strtol(value, NULL, 16) & 0xFFFF;
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (!name) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    struct export* export = export_open(name);
+    if (!export) {
+        return EXIT_FAILURE;
+    }
+    if (slot >= export_slots(export)) {
+        printf("Error: %s has %u instances\n", name, export_slots(export));
+        export_destroy(export);
+        return EXIT_FAILURE;
+    }
+    if (keys >= 0) {
+        export_send_input(export, slot, (uint16_t)keys);
+    }
+
+    struct export_state state;
+    if (all) {
+        for (uint32_t n = 0; n < export_slots(export); ++n) {
+            export_read(export, n, &state);
+            printf("#%-5u frame %-10llu pc %04X i %04X keys %04X\n", n,
+                   (unsigned long long)state.frame, state.pc, state.i,
+                   state.key);
+        }
+    } else {
+        export_read(export, slot, &state);
+        print_state(slot, &state);
+    }
+    export_destroy(export);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,517 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "cpu.h"
+#include "trace.h"
+
+// frames between checkpoints, the last frame is always one too
+#define CHECKPOINT_FRAMES 30
+#define MAX_INPUTS 64
+#define MAX_LINE 1024
+
+struct input {
+    uint32_t frame;
+    uint16_t keys;
+};
+
+struct checkpoint {
+    uint32_t frame;
+    uint32_t display;
+    uint32_t ram;
+};
+
+struct test {
+    char name[64];
+    char rom[512];
+    char golden[512];
+    uint32_t frames;
+    uint32_t ipf;
+    uint8_t mode;
+    // key mask held from each frame on, sorted by frame
+    struct input inputs[MAX_INPUTS];
+    uint32_t input_count;
+    // where the test's instructions go with --trace
+    struct trace_ring* trace;
+
+    // filled in by the worker
+    bool failed;
+    char error[128];
+    // the first checkpoint that differs and the screen at that frame
+    struct checkpoint expected;
+    struct checkpoint actual;
+    uint32_t last_match;
+    struct display display;
+};
+
+struct suite {
+    struct test* tests;
+    uint32_t count;
+    uint32_t next;
+    bool update;
+    // directory of the manifest, with a trailing slash
+    char dir[256];
+};
+
+static uint32_t crc_table[256];
+
+static void usage(void) {
+    printf("usage: chip8-regress [options] manifest\n"
+           "  --jobs N      worker threads (default: all cores)\n"
+           "  --update      rewrite the golden files from this run\n"
+           "  --trace FILE  trace the first 64 tests, ring N is test N\n"
+           "\n"
+           "each manifest line is: name rom frames ipf [mode] "
+           "[frame:keys]...\n"
+           "mode is chip8 (the default), schip or xochip. keys is the hex\n"
+           "key mask held from that frame on. ROMs and golden/NAME.txt are\n"
+           "relative to the manifest.\n\n");
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// CRC-32 as in zlib, so golden values can be checked with other tools
+static void crc_init(void) {
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t crc = n;
+        for (uint32_t bit = 0; bit < 8; ++bit) {
+            crc = crc & 1U ? (crc >> 1U) ^ 0xEDB88320U : crc >> 1U;
+        }
+        crc_table[n] = crc;
+    }
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len) {
+    crc = ~crc;
+    for (size_t n = 0; n < len; ++n) {
+        crc = crc_table[(crc ^ data[n]) & 0xFFU] ^ (crc >> 8U);
+    }
+    return ~crc;
+}
+
+// the visible rows as big endian bytes, leftmost pixel first, independent
+// of the host. the second plane only counts once something is drawn to it,
+// so a CHIP-8 screen hashes as 32 rows of 8 bytes.
+static uint32_t display_crc(const struct display* display) {
+    const uint32_t row_bytes = display->width / 8;
+    uint32_t crc = 0;
+    for (uint32_t plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        uint8_t bytes[DISPLAY_MAX_HEIGHT * DISPLAY_ROW_BYTES];
+        bool lit = false;
+        for (uint32_t y = 0; y < display->height; ++y) {
+            uint8_t row[DISPLAY_ROW_BYTES];
+            display_put_row(row, display->rows[plane][y]);
+            memcpy(&bytes[y * row_bytes], row, row_bytes);
+            lit |= display->rows[plane][y] != 0;
+        }
+        if (plane == 0 || lit) {
+            crc = crc32(crc, bytes, (size_t)display->height * row_bytes);
+        }
+    }
+    return crc;
+}
+
+static uint32_t ram_crc(const struct cpu* cpu) {
+    uint32_t crc = 0;
+    for (uint32_t page = 0; page < PAGE_COUNT; ++page) {
+        crc = crc32(crc, cpu_page_data(cpu, page), cpu_page_size(cpu));
+    }
+    return crc;
+}
+
+static uint32_t checkpoint_count(const struct test* test) {
+    return (test->frames + CHECKPOINT_FRAMES - 1) / CHECKPOINT_FRAMES;
+}
+
+static bool is_checkpoint(const struct test* test, uint32_t frame) {
+    return frame % CHECKPOINT_FRAMES == 0 || frame == test->frames;
+}
+
+static bool read_golden(struct test* test, struct checkpoint* golden,
+                        uint32_t count) {
+    FILE* file = fopen(test->golden, "re");
+    if (!file) {
+        snprintf(test->error, sizeof(test->error),
+                 "no golden file, run with --update");
+        return false;
+    }
+    char line[MAX_LINE];
+    uint32_t read = 0;
+    bool valid = true;
+    while (valid && fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        struct checkpoint* cp = &golden[read];
+        valid = read < count && sscanf(line, "%u %x %x", &cp->frame,
+                                       &cp->display, &cp->ram) == 3;
+        read++;
+    }
+    fclose(file);
+    if (!valid || read != count) {
+        snprintf(test->error, sizeof(test->error),
+                 "golden file does not match the manifest, run with "
+                 "--update");
+        return false;
+    }
+    return true;
+}
+
+static bool write_golden(struct test* test, const struct checkpoint* actual,
+                         uint32_t count) {
+    FILE* file = fopen(test->golden, "we");
+    if (!file) {
+        snprintf(test->error, sizeof(test->error),
+                 "failed to write the golden file");
+        return false;
+    }
+    fprintf(file, "# frame display ram\n");
+    for (uint32_t n = 0; n < count; ++n) {
+        fprintf(file, "%u %08x %08x\n", actual[n].frame, actual[n].display,
+                actual[n].ram);
+    }
+    if (fclose(file) != 0) {
+        snprintf(test->error, sizeof(test->error),
+                 "failed to write the golden file");
+        return false;
+    }
+    return true;
+}
+
+// runs the test to the end, or to the first checkpoint off the golden one
+static void run(struct test* test, struct cpu* cpu,
+                const struct checkpoint* golden, struct checkpoint* actual) {
+    uint32_t input = 0;
+    uint32_t checkpoint = 0;
+    for (uint32_t frame = 1; frame <= test->frames; ++frame) {
+        // inputs apply from the frame they name, counting from zero
+        while (input < test->input_count &&
+               test->inputs[input].frame < frame) {
+            cpu->key = test->inputs[input++].keys;
+        }
+        for (uint32_t c = 0; c < test->ipf; ++c) {
+            cpu_emulate_cycle(cpu);
+        }
+        if (!is_checkpoint(test, frame)) {
+            continue;
+        }
+
+        struct checkpoint* cp = &actual[checkpoint];
+        *cp = (struct checkpoint){
+            .frame = frame,
+            .display = display_crc(cpu->display),
+            .ram = ram_crc(cpu),
+        };
+        if (golden) {
+            const struct checkpoint* expected = &golden[checkpoint];
+            if (cp->frame != expected->frame ||
+                cp->display != expected->display ||
+                cp->ram != expected->ram) {
+                test->failed = true;
+                test->expected = *expected;
+                test->actual = *cp;
+                test->display = *cpu->display;
+                return;
+            }
+            test->last_match = frame;
+        }
+        checkpoint++;
+    }
+}
+
+static void run_test(struct test* test, struct cpu_pool* pool, bool update) {
+    const uint32_t count = checkpoint_count(test);
+    struct checkpoint* golden = calloc(count, sizeof(struct checkpoint));
+    struct checkpoint* actual = calloc(count, sizeof(struct checkpoint));
+    struct rom* rom = NULL;
+    struct cpu* cpu = NULL;
+    if (!golden || !actual) {
+        snprintf(test->error, sizeof(test->error), "out of memory");
+        goto DONE;
+    }
+    if (!update && !read_golden(test, golden, count)) {
+        goto DONE;
+    }
+
+    rom = rom_load(test->rom);
+    cpu = rom ? cpu_create(pool) : NULL;
+    if (!cpu) {
+        snprintf(test->error, sizeof(test->error), "failed to load the ROM");
+        goto DONE;
+    }
+    cpu_set_mode(cpu, test->mode);
+    if (!cpu_load_application(cpu, rom)) {
+        snprintf(test->error, sizeof(test->error), "ROM too big");
+        goto DONE;
+    }
+    cpu_seed(cpu, 1);
+    cpu_set_clock(cpu, test->ipf * 60);
+    cpu->trace = test->trace;
+
+    run(test, cpu, update ? NULL : golden, actual);
+    if (update) {
+        write_golden(test, actual, count);
+    }
+
+DONE:
+    cpu_destroy(cpu);
+    rom_destroy(rom);
+    free(actual);
+    free(golden);
+}
+
+static void* worker(void* arg) {
+    struct suite* suite = arg;
+    struct cpu_pool pool;
+    const bool ready = cpu_pool_init(&pool, 1) == 0;
+    while (true) {
+        const uint32_t n = __atomic_fetch_add(&suite->next, 1,
+                                              __ATOMIC_RELAXED);
+        if (n >= suite->count) {
+            break;
+        }
+        if (ready) {
+            run_test(&suite->tests[n], &pool, suite->update);
+        } else {
+            snprintf(suite->tests[n].error, sizeof(suite->tests[n].error),
+                     "out of memory");
+        }
+    }
+    if (ready) {
+        cpu_pool_destroy(&pool);
+    }
+    return NULL;
+}
+
+static bool parse_test(struct test* test, char* line, const char* dir) {
+    const char* name = strtok(line, " \t\n");
+    const char* rom = strtok(NULL, " \t\n");
+    const char* frames = strtok(NULL, " \t\n");
+    const char* ipf = strtok(NULL, " \t\n");
+    if (!ipf || strlen(name) >= sizeof(test->name)) {
+        return false;
+    }
+    strcpy(test->name, name);
+    snprintf(test->rom, sizeof(test->rom), "%s%s", dir, rom);
+    snprintf(test->golden, sizeof(test->golden), "%sgolden/%s.txt", dir,
+             name);
+    test->frames = strtoul(frames, NULL, 0);
+    test->ipf = strtoul(ipf, NULL, 0);
+
+    const char* arg = strtok(NULL, " \t\n");
+    if (arg && !strchr(arg, ':')) {
+        test->mode = cpu_mode_from_name(arg);
+        if (test->mode == CPU_MODES) {
+            return false;
+        }
+        arg = strtok(NULL, " \t\n");
+    }
+    for (; arg; arg = strtok(NULL, " \t\n")) {
+        unsigned frame = 0;
+        unsigned keys = 0;
+        if (test->input_count == MAX_INPUTS ||
+            sscanf(arg, "%u:%x", &frame, &keys) != 2 ||
+            (test->input_count > 0 &&
+             frame <= test->inputs[test->input_count - 1].frame)) {
+            return false;
+        }
+        test->inputs[test->input_count++] = (struct input){
+            .frame = frame,
+            .keys = (uint16_t)keys,
+        };
+    }
+    return test->frames > 0;
+}
+
+static bool load_manifest(struct suite* suite, const char* filename) {
+    FILE* file = fopen(filename, "re");
+    if (!file) {
+        fputs("File error", stderr);
+        return false;
+    }
+
+    // paths in the manifest are relative to its directory
+    char* dir = suite->dir;
+    const char* slash = strrchr(filename, '/');
+    if (slash && (size_t)(slash - filename) + 1 < sizeof(suite->dir)) {
+        memcpy(dir, filename, slash - filename + 1);
+        dir[slash - filename + 1] = '\0';
+    }
+
+    char line[MAX_LINE];
+    uint32_t capacity = 0;
+    uint32_t number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        const char* start = line + strspn(line, " \t");
+        if (*start == '#' || *start == '\n' || *start == '\0') {
+            continue;
+        }
+        if (suite->count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            struct test* tests =
+                realloc(suite->tests, capacity * sizeof(struct test));
+            if (!tests) {
+                fputs("Memory error", stderr);
+                fclose(file);
+                return false;
+            }
+            suite->tests = tests;
+        }
+        struct test* test = &suite->tests[suite->count];
+        memset(test, 0, sizeof(struct test));
+        if (!parse_test(test, line, dir)) {
+            printf("Error: %s:%u is not a valid test\n", filename, number);
+            fclose(file);
+            return false;
+        }
+        suite->count++;
+    }
+    fclose(file);
+    return true;
+}
+
+static void print_screen(const struct display* display) {
+    for (uint32_t y = 0; y < display->height; ++y) {
+        char row[DISPLAY_MAX_WIDTH + 1];
+        for (uint32_t x = 0; x < display->width; ++x) {
+            row[x] = DISPLAY_ASCII[display_pixel(display, x, y)];
+        }
+        row[display->width] = '\0';
+        printf("    %s\n", row);
+    }
+}
+
+// prints every failure with the first frame that differs
+static uint32_t report(const struct suite* suite) {
+    uint32_t failures = 0;
+    for (uint32_t n = 0; n < suite->count; ++n) {
+        const struct test* test = &suite->tests[n];
+        if (test->error[0]) {
+            printf("FAIL %s: %s\n", test->name, test->error);
+            failures++;
+            continue;
+        }
+        if (!test->failed) {
+            printf("ok   %s\n", test->name);
+            continue;
+        }
+        failures++;
+        printf("FAIL %s: first mismatch at frame %u, last match at frame "
+               "%u\n",
+               test->name, test->actual.frame, test->last_match);
+        printf("    display %08x, expected %08x\n", test->actual.display,
+               test->expected.display);
+        printf("    ram     %08x, expected %08x\n", test->actual.ram,
+               test->expected.ram);
+        print_screen(&test->display);
+    }
+    return failures;
+}
+
+int main(int argc, char* argv[]) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t jobs = cores > 0 ? (uint32_t)cores : 1;
+    struct suite suite = {0};
+    const char* manifest = NULL;
+    const char* trace_filename = NULL;
+
+    for (int32_t n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        const char* value = n + 1 < argc ? argv[n + 1] : NULL;
+        if (arg[0] != '-') {
+            manifest = arg;
+            continue;
+        }
+        if (strcmp(arg, "--update") == 0) {
+            suite.update = true;
+            continue;
+        }
+        if (!value) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        n++;
+
+        if (strcmp(arg, "--jobs") == 0) {
+            jobs = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--trace") == 0) {
+            trace_filename = value;
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (!manifest || jobs == 0) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    crc_init();
+    if (!load_manifest(&suite, manifest)) {
+        free(suite.tests);
+        return EXIT_FAILURE;
+    }
+    if (suite.update) {
+        char golden[sizeof(suite.dir) + 8];
+        snprintf(golden, sizeof(golden), "%sgolden", suite.dir);
+        mkdir(golden, 0755);
+    }
+    // rings are numbered in attach order, so ring n is test n
+    struct trace* trace = NULL;
+    if (trace_filename) {
+        trace = trace_create(trace_filename, true);
+        for (uint32_t n = 0; trace && n < suite.count && n < TRACE_MAX_RINGS;
+             ++n) {
+            suite.tests[n].trace = trace_attach(trace);
+            if (!suite.tests[n].trace) {
+                trace_destroy(trace);
+                trace = NULL;
+            }
+        }
+        if (!trace) {
+            free(suite.tests);
+            return EXIT_FAILURE;
+        }
+    }
+    if (jobs > suite.count) {
+        jobs = suite.count ? suite.count : 1;
+    }
+
+    const double start = now();
+    pthread_t* threads = calloc(jobs, sizeof(pthread_t));
+    if (!threads) {
+        fputs("Memory error", stderr);
+        trace_destroy(trace);
+        free(suite.tests);
+        return EXIT_FAILURE;
+    }
+    uint32_t started = 0;
+    while (started < jobs &&
+           pthread_create(&threads[started], NULL, worker, &suite) == 0) {
+        started++;
+    }
+    // a thread that failed to start leaves its share to the others
+    if (started == 0) {
+        worker(&suite);
+    }
+    for (uint32_t n = 0; n < started; ++n) {
+        pthread_join(threads[n], NULL);
+    }
+    free(threads);
+    trace_destroy(trace);
+
+    const uint32_t failures = report(&suite);
+    printf("%u passed, %u failed in %.2f s%s\n", suite.count - failures,
+           failures, now() - start, suite.update ? ", golden files updated"
+                                                 : "");
+    free(suite.tests);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
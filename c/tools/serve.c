@@ -0,0 +1,288 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cpu.h"
+#include "export.h"
+#include "pack.h"
+#include "record.h"
+#include "stream.h"
+#include "trace.h"
+
+#define NANOSECONDS_PER_SECOND 1000000000LL
+
+struct options {
+    uint32_t instances;
+    uint32_t ipf;
+    uint32_t fps;
+    uint64_t frames;
+    const char* rom;
+    const char* pack;
+    const char* stream;
+    const char* export;
+    const char* record;
+    const char* trace;
+    const char* mode;
+};
+
+static void usage(void) {
+    printf("usage: chip8-serve [options] rom\n"
+           "  --instances N     instances to run (default 1)\n"
+           "  --ipf N           instructions per frame (default 10, or the "
+           "pack's)\n"
+           "  --fps N           frames per second, 0 runs flat out "
+           "(default 60)\n"
+           "  --frames N        stop after N frames (default: never)\n"
+           "  --pack FILE       rom is the name of a ROM in FILE\n"
+           "  --stream SOCKET   serve the screens, see chip8-watch\n"
+           "  --export NAME     share state and take keys, see chip8-peek\n"
+           "  --record FILE     record instance 0, see chip8-video\n"
+           "  --trace FILE      trace the first 64 instances, see "
+           "chip8-trace\n"
+           "  --mode MODE       chip8, schip or xochip (default chip8, or "
+           "the pack's)\n\n");
+}
+
+// set by SIGINT and SIGTERM, so the trace and recording get finished
+static volatile sig_atomic_t stopping;
+
+static void stop(int signal) {
+    (void)signal;
+    stopping = 1;
+}
+
+static int64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NANOSECONDS_PER_SECOND + ts.tv_nsec;
+}
+
+// sleeps until deadline, in the stream's event loop if there is one
+static void wait_until(struct stream* stream, int64_t deadline) {
+    while (true) {
+        const int64_t left = deadline - now();
+        if (left <= 0 || stopping) {
+            if (stream) {
+                stream_poll(stream, 0);
+            }
+            return;
+        }
+        if (stream) {
+            stream_poll(stream, (int32_t)((left + 999999) / 1000000));
+        } else {
+            struct timespec ts = {
+                .tv_sec = left / NANOSECONDS_PER_SECOND,
+                .tv_nsec = left % NANOSECONDS_PER_SECOND,
+            };
+            nanosleep(&ts, NULL);
+        }
+    }
+}
+
+static void serve(const struct options* options, struct cpu** cpus,
+                  struct stream* stream, struct export* export,
+                  struct record* record) {
+    const int64_t period =
+        options->fps ? NANOSECONDS_PER_SECOND / options->fps : 0;
+    int64_t deadline = now();
+
+    for (uint64_t frame = 0;
+         !stopping && (!options->frames || frame < options->frames);
+         ++frame) {
+        for (uint32_t n = 0; n < options->instances; ++n) {
+            struct cpu* cpu = cpus[n];
+            if (export) {
+                export_poll_input(export, n, cpu);
+            }
+            for (uint32_t c = 0; c < options->ipf; ++c) {
+                cpu_emulate_cycle(cpu);
+            }
+            if (record && n == 0) {
+                record_frame(record, cpu->display, cpu_st(cpu) > 0);
+            }
+            if (cpu->draw_flag) {
+                if (stream) {
+                    stream_publish(stream, n, cpu->display, (uint32_t)frame);
+                }
+                cpu->draw_flag = false;
+            }
+            if (export) {
+                export_publish(export, n, cpu, frame);
+            }
+        }
+
+        deadline += period;
+        wait_until(stream, deadline);
+        if (deadline < now() - NANOSECONDS_PER_SECOND) {
+            // fell way behind, don't try to catch up in a burst
+            deadline = now();
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    struct options options = {.instances = 1, .ipf = 10, .fps = 60};
+    bool ipf_set = false;
+
+    for (int32_t n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        const char* value = n + 1 < argc ? argv[n + 1] : NULL;
+        if (arg[0] != '-') {
+            options.rom = arg;
+            continue;
+        }
+        if (!value) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        n++;
+
+        if (strcmp(arg, "--instances") == 0) {
+            options.instances = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--ipf") == 0) {
+            options.ipf = strtoul(value, NULL, 0);
+            ipf_set = true;
+        } else if (strcmp(arg, "--fps") == 0) {
+            options.fps = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--frames") == 0) {
+            options.frames = strtoull(value, NULL, 0);
+        } else if (strcmp(arg, "--pack") == 0) {
+            options.pack = value;
+        } else if (strcmp(arg, "--stream") == 0) {
+            options.stream = value;
+        } else if (strcmp(arg, "--export") == 0) {
+            options.export = value;
+        } else if (strcmp(arg, "--record") == 0) {
+            options.record = value;
+        } else if (strcmp(arg, "--trace") == 0) {
+            options.trace = value;
+        } else if (strcmp(arg, "--mode") == 0) {
+            options.mode = value;
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (!options.rom || options.instances == 0 ||
+        (options.mode && cpu_mode_from_name(options.mode) == CPU_MODES)) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    struct rom* rom = NULL;
+    struct pack* pack = NULL;
+    struct pack_rom packed;
+    uint8_t mode = CPU_CHIP8;
+    if (options.pack) {
+        pack = pack_open(options.pack);
+        if (!pack || !pack_find(pack, options.rom, &packed)) {
+            printf("Failed to load chip8 application");
+            pack_close(pack);
+            return EXIT_FAILURE;
+        }
+        if (packed.ipf && !ipf_set) {
+            options.ipf = packed.ipf;
+        }
+        if (packed.profile < CPU_MODES) {
+            mode = packed.profile;
+        }
+    } else {
+        rom = rom_load(options.rom);
+        if (!rom) {
+            printf("Failed to load chip8 application");
+            return EXIT_FAILURE;
+        }
+    }
+    const struct rom* app = pack ? &packed.rom : rom;
+    if (options.mode) {
+        mode = cpu_mode_from_name(options.mode);
+    }
+
+    struct cpu_pool pool;
+    if (cpu_pool_init(&pool, 64) != 0) {
+        rom_destroy(rom);
+        pack_close(pack);
+        return EXIT_FAILURE;
+    }
+    struct cpu** cpus = calloc(options.instances, sizeof(struct cpu*));
+    struct stream* stream = NULL;
+    struct export* export = NULL;
+    struct record* record = NULL;
+    struct trace* trace = NULL;
+    int32_t status = EXIT_FAILURE;
+    if (!cpus) {
+        fputs("Memory error", stderr);
+        goto DONE;
+    }
+    for (uint32_t n = 0; n < options.instances; ++n) {
+        cpus[n] = cpu_create(&pool);
+        if (!cpus[n]) {
+            goto DONE;
+        }
+        cpu_set_mode(cpus[n], mode);
+        if (!cpu_load_application(cpus[n], app)) {
+            goto DONE;
+        }
+        cpu_seed(cpus[n], n + 1);
+        cpu_set_clock(cpus[n], options.ipf * 60);
+    }
+    if (options.stream) {
+        stream = stream_create(options.stream, options.instances);
+        if (!stream) {
+            goto DONE;
+        }
+    }
+    if (options.export) {
+        export = export_create(options.export, options.instances);
+        if (!export) {
+            goto DONE;
+        }
+    }
+
+    if (options.record) {
+        // flat out runs can afford to wait for the encoder, real time ones
+        // never fall behind
+        record = record_create(options.record, options.fps == 0);
+        if (!record) {
+            goto DONE;
+        }
+    }
+
+    if (options.trace) {
+        trace = trace_create(options.trace, true);
+        if (!trace) {
+            goto DONE;
+        }
+        // rings are numbered in attach order, so ring n is instance n
+        for (uint32_t n = 0; n < options.instances && n < TRACE_MAX_RINGS;
+             ++n) {
+            cpus[n]->trace = trace_attach(trace);
+            if (!cpus[n]->trace) {
+                goto DONE;
+            }
+        }
+    }
+
+    struct sigaction action = {.sa_handler = stop};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    serve(&options, cpus, stream, export, record);
+    status = EXIT_SUCCESS;
+
+DONE:
+    trace_destroy(trace);
+    record_destroy(record);
+    export_destroy(export);
+    stream_destroy(stream);
+    for (uint32_t n = 0; cpus && n < options.instances; ++n) {
+        cpu_destroy(cpus[n]);
+    }
+    free(cpus);
+    cpu_pool_destroy(&pool);
+    rom_destroy(rom);
+    pack_close(pack);
+    return status;
+}
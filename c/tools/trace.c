@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "disasm.h"
+#include "trace.h"
+
+// records shown before the first difference
+#define DIFF_CONTEXT 8
+
+struct filter {
+    int64_t ring;
+    uint16_t pc_lo;
+    uint16_t pc_hi;
+    // opcode matches if (opcode & op_mask) == op_value
+    uint16_t op_mask;
+    uint16_t op_value;
+    uint64_t limit;
+};
+
+static void usage(void) {
+    printf("usage: chip8-trace dump [options] trace\n"
+           "       chip8-trace diff [options] trace trace\n"
+           "  --ring N       only records of instance N\n"
+           "  --pc LO-HI     only records with LO <= pc <= HI, hex\n"
+           "  --op PATTERN   only opcodes matching PATTERN, e.g. Dxxx or 8xy4\n"
+           "  --limit N      stop after N records\n\n");
+}
+
+static bool parse_op(const char* pattern, struct filter* filter) {
+    if (strlen(pattern) != 4) {
+        return false;
+    }
+    filter->op_mask = 0;
+    filter->op_value = 0;
+    for (uint32_t n = 0; n < 4; ++n) {
+        char c = pattern[n];
+        uint32_t shift = 12 - n * 4;
+        if (c >= '0' && c <= '9') {
+            filter->op_value |= (c - '0') << shift;
+        } else if (c >= 'A' && c <= 'F') {
+            filter->op_value |= (c - 'A' + 10) << shift;
+        } else if (c >= 'a' && c <= 'f') {
+            filter->op_value |= (c - 'a' + 10) << shift;
+        } else {
+            // any other character is a wildcard nibble
+            continue;
+        }
+        filter->op_mask |= 0xFU << shift;
+    }
+    return true;
+}
+
+static bool matches(const struct filter* filter, uint32_t ring,
+                    const struct trace_record* record) {
+    return (filter->ring < 0 || filter->ring == ring) &&
+           record->pc >= filter->pc_lo && record->pc <= filter->pc_hi &&
+           (record->opcode & filter->op_mask) == filter->op_value;
+}
+
+static bool next(struct trace_reader* reader, const struct filter* filter,
+                 uint32_t* ring, struct trace_record* record) {
+    while (trace_next(reader, ring, record)) {
+        if (matches(filter, *ring, record)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void print_record(const char* prefix, uint64_t index, uint32_t ring,
+                         const struct trace_record* record) {
+    char text[32];
+    disasm_opcode(record->opcode, text, sizeof(text));
+    printf("%s%10llu  #%-2u %04X  %04X  %-18s I=%04X V%X=%02X\n", prefix,
+           (unsigned long long)index, ring, record->pc, record->opcode, text,
+           record->i, record->reg, record->value);
+}
+
+static int32_t dump(const char* filename, const struct filter* filter) {
+    struct trace_reader* reader = trace_open(filename);
+    if (!reader) {
+        return EXIT_FAILURE;
+    }
+
+    uint32_t ring;
+    struct trace_record record;
+    uint64_t index = 0;
+    while (index < filter->limit && next(reader, filter, &ring, &record)) {
+        print_record("", index++, ring, &record);
+    }
+    trace_close(reader);
+    return EXIT_SUCCESS;
+}
+
+static int32_t diff(const char* first, const char* second,
+                    const struct filter* filter) {
+    struct trace_reader* a = trace_open(first);
+    struct trace_reader* b = trace_open(second);
+    if (!a || !b) {
+        trace_close(a);
+        trace_close(b);
+        return EXIT_FAILURE;
+    }
+
+    uint32_t context_ring[DIFF_CONTEXT];
+    struct trace_record context[DIFF_CONTEXT];
+    uint64_t index = 0;
+    int32_t status = EXIT_SUCCESS;
+
+    while (index < filter->limit) {
+        uint32_t ring_a;
+        uint32_t ring_b;
+        struct trace_record rec_a;
+        struct trace_record rec_b;
+        bool more_a = next(a, filter, &ring_a, &rec_a);
+        bool more_b = next(b, filter, &ring_b, &rec_b);
+
+        if (!more_a && !more_b) {
+            break;
+        }
+        if (more_a && more_b && ring_a == ring_b &&
+            memcmp(&rec_a, &rec_b, sizeof(rec_a)) == 0) {
+            context_ring[index % DIFF_CONTEXT] = ring_a;
+            context[index % DIFF_CONTEXT] = rec_a;
+            index++;
+            continue;
+        }
+
+        printf("traces differ at record %llu\n", (unsigned long long)index);
+        uint64_t from = index > DIFF_CONTEXT ? index - DIFF_CONTEXT : 0;
+        for (uint64_t n = from; n < index; ++n) {
+            print_record("  ", n, context_ring[n % DIFF_CONTEXT],
+                         &context[n % DIFF_CONTEXT]);
+        }
+        if (more_a) {
+            print_record("< ", index, ring_a, &rec_a);
+        } else {
+            printf("< %10llu  end of trace\n", (unsigned long long)index);
+        }
+        if (more_b) {
+            print_record("> ", index, ring_b, &rec_b);
+        } else {
+            printf("> %10llu  end of trace\n", (unsigned long long)index);
+        }
+        status = EXIT_FAILURE;
+        break;
+    }
+
+    if (status == EXIT_SUCCESS) {
+        printf("%llu records identical\n", (unsigned long long)index);
+    }
+    trace_close(a);
+    trace_close(b);
+    return status;
+}
+
+int main(int argc, char* argv[]) {
+    struct filter filter = {
+        .ring = -1,
+        .pc_hi = 0xFFFF,
+        .limit = UINT64_MAX,
+    };
+    const char* files[2] = {NULL, NULL};
+    uint32_t file_count = 0;
+
+    if (argc < 2) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    const char* command = argv[1];
+
+    for (int32_t n = 2; n < argc; ++n) {
+        const char* arg = argv[n];
+        const char* value = n + 1 < argc ? argv[n + 1] : NULL;
+        if (arg[0] != '-') {
+            if (file_count == 2) {
+                usage();
+                return EXIT_FAILURE;
+            }
+            files[file_count++] = arg;
+            continue;
+        }
+        if (!value) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        n++;
+
+        if (strcmp(arg, "--ring") == 0) {
+            filter.ring = strtol(value, NULL, 0);
+        } else if (strcmp(arg, "--pc") == 0) {
+            unsigned int lo = 0;
+            unsigned int hi = 0;
+            if (sscanf(value, "%x-%x", &lo, &hi) != 2) {
+                usage();
+                return EXIT_FAILURE;
+            }
+            filter.pc_lo = (uint16_t)lo;
+            filter.pc_hi = (uint16_t)hi;
+        } else if (strcmp(arg, "--op") == 0) {
+            if (!parse_op(value, &filter)) {
+                usage();
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(arg, "--limit") == 0) {
+            filter.limit = strtoull(value, NULL, 0);
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (strcmp(command, "dump") == 0 && file_count == 1) {
+        return dump(files[0], &filter);
+    }
+    if (strcmp(command, "diff") == 0 && file_count == 2) {
+        return diff(files[0], files[1], &filter);
+    }
+    usage();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "record.h"
+
+#define WAV_RATE 48000U
+#define WAV_SAMPLES_PER_FRAME (WAV_RATE / RECORD_FPS)
+#define WAV_TONE 440U
+#define WAV_AMPLITUDE 32
+
+#define GIF_MIN_CODE_SIZE 2U
+#define GIF_CLEAR (1U << GIF_MIN_CODE_SIZE)
+#define GIF_MAX_CODE 4095U
+// most viewers slow frames shorter than this down to 1/10s
+#define GIF_MIN_DELAY 2U
+
+static void usage(void) {
+    printf("usage: chip8-video info recording\n"
+           "       chip8-video y4m [--scale N] recording out.y4m\n"
+           "       chip8-video gif [--scale N] recording out.gif\n"
+           "       chip8-video wav recording out.wav\n"
+           "  --scale N   pixels per hires pixel, lores pixels are twice\n"
+           "              as big (default 4)\n\n");
+}
+
+// one byte per output pixel holding its color, the canvas is the hires
+// resolution and rows are scaled up by scale
+static void rasterize(const struct record_frame* frame, uint32_t scale,
+                      uint8_t* out) {
+    const uint32_t width = DISPLAY_MAX_WIDTH * scale;
+    for (uint32_t y = 0; y < DISPLAY_MAX_HEIGHT; ++y) {
+        uint8_t* row = &out[y * scale * width];
+        for (uint32_t x = 0; x < DISPLAY_MAX_WIDTH; ++x) {
+            const uint8_t pixel = display_canvas_pixel(&frame->display, x, y);
+            memset(&row[x * scale], pixel, scale);
+        }
+        for (uint32_t n = 1; n < scale; ++n) {
+            memcpy(&row[n * width], row, width);
+        }
+    }
+}
+
+static int32_t info(struct record_reader* reader) {
+    struct record_frame frame;
+    uint64_t frames = 0;
+    uint64_t sound = 0;
+    while (record_next(reader, &frame)) {
+        frames++;
+        sound += frame.sound;
+    }
+    printf("%llu frames, %.2f seconds, tone on for %llu frames\n",
+           (unsigned long long)frames, (double)frames / RECORD_FPS,
+           (unsigned long long)sound);
+    return EXIT_SUCCESS;
+}
+
+// video range luma of a palette color
+static uint8_t luma(uint32_t rgb) {
+    const uint32_t r = (rgb >> 16U) & 0xFFU;
+    const uint32_t g = (rgb >> 8U) & 0xFFU;
+    const uint32_t b = rgb & 0xFFU;
+    return (uint8_t)(16 + (219 * (299 * r + 587 * g + 114 * b)) / 255000);
+}
+
+static int32_t y4m(struct record_reader* reader, FILE* out, uint32_t scale) {
+    const size_t size =
+        (size_t)DISPLAY_MAX_WIDTH * DISPLAY_MAX_HEIGHT * scale * scale;
+    uint8_t* pixels = malloc(size);
+    if (!pixels) {
+        fputs("Memory error", stderr);
+        return EXIT_FAILURE;
+    }
+
+    // luma only, in video range
+    fprintf(out, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 Cmono\n",
+            DISPLAY_MAX_WIDTH * scale, DISPLAY_MAX_HEIGHT * scale, RECORD_FPS);
+    uint8_t levels[DISPLAY_COLORS];
+    for (uint32_t n = 0; n < DISPLAY_COLORS; ++n) {
+        levels[n] = luma(display_palette[n]);
+    }
+    struct record_frame frame;
+    while (record_next(reader, &frame)) {
+        rasterize(&frame, scale, pixels);
+        for (size_t n = 0; n < size; ++n) {
+            pixels[n] = levels[pixels[n]];
+        }
+        fputs("FRAME\n", out);
+        fwrite(pixels, 1, size, out);
+    }
+    free(pixels);
+    return EXIT_SUCCESS;
+}
+
+static void put16(FILE* out, uint16_t value) {
+    fputc(value & 0xFFU, out);
+    fputc(value >> 8U, out);
+}
+
+static void put32(FILE* out, uint32_t value) {
+    put16(out, (uint16_t)value);
+    put16(out, (uint16_t)(value >> 16U));
+}
+
+static void wav_header(FILE* out, uint32_t samples) {
+    fputs("RIFF", out);
+    put32(out, 36 + samples);
+    fputs("WAVEfmt ", out);
+    put32(out, 16);
+    put16(out, 1); // PCM
+    put16(out, 1); // mono
+    put32(out, WAV_RATE);
+    put32(out, WAV_RATE);
+    put16(out, 1);
+    put16(out, 8);
+    fputs("data", out);
+    put32(out, samples);
+}
+
+// 8 bit unsigned square wave, the same tone for every frame it is on
+static int32_t wav(struct record_reader* reader, FILE* out) {
+    wav_header(out, 0);
+
+    uint8_t samples[WAV_SAMPLES_PER_FRAME];
+    uint32_t count = 0;
+    // phase in 1/WAV_RATE of a tone period
+    uint32_t phase = 0;
+    struct record_frame frame;
+    while (record_next(reader, &frame)) {
+        for (uint32_t n = 0; n < WAV_SAMPLES_PER_FRAME; ++n) {
+            phase = (phase + WAV_TONE) % WAV_RATE;
+            samples[n] = !frame.sound          ? 128
+                         : phase < WAV_RATE / 2 ? 128 + WAV_AMPLITUDE
+                                                : 128 - WAV_AMPLITUDE;
+        }
+        fwrite(samples, 1, sizeof(samples), out);
+        count += sizeof(samples);
+    }
+
+    if (fseek(out, 0, SEEK_SET) != 0) {
+        fputs("Writing error", stderr);
+        return EXIT_FAILURE;
+    }
+    wav_header(out, count);
+    return EXIT_SUCCESS;
+}
+
+struct gif {
+    FILE* out;
+    uint32_t bits;
+    uint32_t bit_count;
+    uint8_t block[255];
+    uint32_t block_len;
+    // LZW dictionary as a trie over the 4 symbol alphabet
+    uint16_t child[GIF_MAX_CODE + 1][GIF_CLEAR];
+};
+
+static void gif_byte(struct gif* gif, uint8_t byte) {
+    gif->block[gif->block_len++] = byte;
+    if (gif->block_len == sizeof(gif->block)) {
+        fputc((int)gif->block_len, gif->out);
+        fwrite(gif->block, 1, gif->block_len, gif->out);
+        gif->block_len = 0;
+    }
+}
+
+static void gif_code(struct gif* gif, uint32_t code, uint32_t width) {
+    gif->bits |= code << gif->bit_count;
+    gif->bit_count += width;
+    while (gif->bit_count >= 8) {
+        gif_byte(gif, (uint8_t)gif->bits);
+        gif->bits >>= 8U;
+        gif->bit_count -= 8;
+    }
+}
+
+static void gif_image(struct gif* gif, const uint8_t* pixels, size_t count) {
+    uint32_t width = GIF_MIN_CODE_SIZE + 1;
+    uint32_t max_code = GIF_CLEAR + 1;
+    memset(gif->child, 0, sizeof(gif->child));
+    fputc(GIF_MIN_CODE_SIZE, gif->out);
+    gif_code(gif, GIF_CLEAR, width);
+
+    uint32_t code = pixels[0];
+    for (size_t n = 1; n < count; ++n) {
+        const uint8_t next = pixels[n];
+        if (gif->child[code][next]) {
+            code = gif->child[code][next];
+            continue;
+        }
+        gif_code(gif, code, width);
+        gif->child[code][next] = (uint16_t)++max_code;
+        if (max_code >= (1U << width)) {
+            width++;
+        }
+        if (max_code == GIF_MAX_CODE) {
+            gif_code(gif, GIF_CLEAR, width);
+            memset(gif->child, 0, sizeof(gif->child));
+            width = GIF_MIN_CODE_SIZE + 1;
+            max_code = GIF_CLEAR + 1;
+        }
+        code = next;
+    }
+    gif_code(gif, code, width);
+    gif_code(gif, GIF_CLEAR, width);
+    gif_code(gif, GIF_CLEAR + 1, GIF_MIN_CODE_SIZE + 1);
+
+    if (gif->bit_count) {
+        gif_byte(gif, (uint8_t)gif->bits);
+    }
+    if (gif->block_len) {
+        fputc((int)gif->block_len, gif->out);
+        fwrite(gif->block, 1, gif->block_len, gif->out);
+    }
+    fputc(0, gif->out);
+    gif->bits = 0;
+    gif->bit_count = 0;
+    gif->block_len = 0;
+}
+
+static void gif_frame(struct gif* gif, const uint8_t* pixels, uint32_t w,
+                      uint32_t h, uint32_t delay) {
+    const uint8_t control[] = {0x21, 0xF9, 0x04, 0x00, delay & 0xFFU,
+                               delay >> 8U, 0x00, 0x00};
+    fwrite(control, 1, sizeof(control), gif->out);
+    fputc(0x2C, gif->out);
+    put16(gif->out, 0);
+    put16(gif->out, 0);
+    put16(gif->out, (uint16_t)w);
+    put16(gif->out, (uint16_t)h);
+    fputc(0x00, gif->out);
+    gif_image(gif, pixels, (size_t)w * h);
+}
+
+/*
+GIF delays are in 1/100s, so frames are timed by rounding their 60Hz
+timestamps. runs of identical frames become one GIF frame, and changes
+coming faster than GIF_MIN_DELAY are folded into the next frame shown.
+*/
+static int32_t gif(struct record_reader* reader, FILE* out, uint32_t scale) {
+    const uint32_t w = DISPLAY_MAX_WIDTH * scale;
+    const uint32_t h = DISPLAY_MAX_HEIGHT * scale;
+    struct gif* gif = calloc(1, sizeof(struct gif));
+    uint8_t* shown = malloc((size_t)w * h);
+    uint8_t* pixels = malloc((size_t)w * h);
+    if (!gif || !shown || !pixels) {
+        fputs("Memory error", stderr);
+        free(gif);
+        free(shown);
+        free(pixels);
+        return EXIT_FAILURE;
+    }
+    gif->out = out;
+
+    fputs("GIF89a", out);
+    put16(out, (uint16_t)w);
+    put16(out, (uint16_t)h);
+    // global table of the 4 display colors
+    const uint8_t screen[] = {0xF1, 0x00, 0x00};
+    fwrite(screen, 1, sizeof(screen), out);
+    for (uint32_t n = 0; n < DISPLAY_COLORS; ++n) {
+        fputc((int)(display_palette[n] >> 16U) & 0xFF, out);
+        fputc((int)(display_palette[n] >> 8U) & 0xFF, out);
+        fputc((int)display_palette[n] & 0xFF, out);
+    }
+    // loop forever
+    const uint8_t loop[] = {0x21, 0xFF, 0x0B, 'N',  'E',  'T',  'S',
+                            'C',  'A',  'P',  'E',  '2',  '.',  '0',
+                            0x03, 0x01, 0x00, 0x00, 0x00};
+    fwrite(loop, 1, sizeof(loop), out);
+
+    struct record_frame frame;
+    uint64_t index = 0;
+    // centiseconds at which the pending frame went up
+    uint64_t shown_at = 0;
+    bool pending = false;
+    while (record_next(reader, &frame)) {
+        const uint64_t at = (index++ * 100 + RECORD_FPS / 2) / RECORD_FPS;
+        rasterize(&frame, scale, pixels);
+        if (!pending) {
+            memcpy(shown, pixels, (size_t)w * h);
+            pending = true;
+            continue;
+        }
+        if (memcmp(pixels, shown, (size_t)w * h) == 0) {
+            continue;
+        }
+        if (at - shown_at < GIF_MIN_DELAY) {
+            memcpy(shown, pixels, (size_t)w * h);
+            continue;
+        }
+        gif_frame(gif, shown, w, h, (uint32_t)(at - shown_at));
+        memcpy(shown, pixels, (size_t)w * h);
+        shown_at = at;
+    }
+    if (pending) {
+        const uint64_t end = (index * 100 + RECORD_FPS / 2) / RECORD_FPS;
+        gif_frame(gif, shown, w, h,
+                  (uint32_t)(end > shown_at ? end - shown_at : 1));
+    }
+    fputc(0x3B, out);
+
+    free(gif);
+    free(shown);
+    free(pixels);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    const char* files[2] = {NULL, NULL};
+    uint32_t file_count = 0;
+    uint32_t scale = 4;
+
+    if (argc < 2) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    const char* command = argv[1];
+
+    for (int32_t n = 2; n < argc; ++n) {
+        const char* arg = argv[n];
+        if (arg[0] != '-') {
+            if (file_count == 2) {
+                usage();
+                return EXIT_FAILURE;
+            }
+            files[file_count++] = arg;
+            continue;
+        }
+        if (strcmp(arg, "--scale") == 0 && n + 1 < argc) {
+            scale = strtoul(argv[++n], NULL, 0);
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    const bool is_info = strcmp(command, "info") == 0;
+    if (!is_info && strcmp(command, "y4m") != 0 &&
+        strcmp(command, "gif") != 0 && strcmp(command, "wav") != 0) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    if (file_count != (is_info ? 1U : 2U) || scale == 0 || scale > 32) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    struct record_reader* reader = record_open(files[0]);
+    if (!reader) {
+        return EXIT_FAILURE;
+    }
+    if (is_info) {
+        const int32_t status = info(reader);
+        record_close(reader);
+        return status;
+    }
+
+    FILE* out = fopen(files[1], "wbe");
+    if (!out) {
+        fputs("File error", stderr);
+        record_close(reader);
+        return EXIT_FAILURE;
+    }
+
+    int32_t status;
+    if (strcmp(command, "y4m") == 0) {
+        status = y4m(reader, out, scale);
+    } else if (strcmp(command, "gif") == 0) {
+        status = gif(reader, out, scale);
+    } else {
+        status = wav(reader, out);
+    }
+
+    if (fclose(out) != 0) {
+        fputs("Writing error", stderr);
+        status = EXIT_FAILURE;
+    }
+    record_close(reader);
+    return status;
+}
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "display.h"
+#include "stream.h"
+
+#define MAX_WATCHED 64
+// instance ids beyond this are taken as garbage, 64 K displays take 135 MB
+#define MAX_INSTANCES 65536
+
+struct watcher {
+    // reconstructed displays, grown as instance ids show up
+    struct display* displays;
+    uint32_t capacity;
+
+    uint64_t messages;
+    uint64_t keyframes;
+    uint64_t bytes;
+};
+
+static void usage(void) {
+    printf("usage: chip8-watch [options] socket\n"
+           "  --instance N   instance to watch, repeatable (default all)\n"
+           "  --messages N   stop after N messages (default: never)\n"
+           "  --screen       print the screen after every message\n\n");
+}
+
+static bool grow(struct watcher* watcher, uint32_t id) {
+    if (id < watcher->capacity) {
+        return true;
+    }
+    if (id >= MAX_INSTANCES) {
+        printf("Error: instance %u out of range\n", id);
+        return false;
+    }
+    uint32_t capacity = watcher->capacity ? watcher->capacity : 64;
+    while (capacity <= id) {
+        capacity *= 2;
+    }
+    struct display* displays =
+        realloc(watcher->displays, capacity * sizeof(*displays));
+    if (!displays) {
+        fputs("Memory error", stderr);
+        return false;
+    }
+    watcher->displays = displays;
+    memset(&displays[watcher->capacity], 0,
+           (capacity - watcher->capacity) * sizeof(*displays));
+    watcher->capacity = capacity;
+    return true;
+}
+
+static bool read_full(int fd, void* data, size_t len) {
+    uint8_t* bytes = data;
+    while (len > 0) {
+        const ssize_t n = read(fd, bytes, len);
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void print_screen(const struct stream_message* msg,
+                         const struct display* display) {
+    printf("#%u frame %u %s, %u bytes\n", msg->instance, msg->frame,
+           msg->type == STREAM_KEYFRAME ? "keyframe" : "delta", msg->size);
+    for (uint32_t y = 0; y < display->height; ++y) {
+        char row[DISPLAY_MAX_WIDTH + 1];
+        for (uint32_t x = 0; x < display->width; ++x) {
+            row[x] = DISPLAY_ASCII[display_pixel(display, x, y)];
+        }
+        row[display->width] = '\0';
+        puts(row);
+    }
+}
+
+static bool handle(struct watcher* watcher, const struct stream_message* msg,
+                   const uint8_t* data, bool screen) {
+    if (!grow(watcher, msg->instance)) {
+        return false;
+    }
+    struct display* display = &watcher->displays[msg->instance];
+    watcher->messages++;
+    watcher->bytes += sizeof(*msg) + msg->size;
+
+    if (msg->type == STREAM_KEYFRAME) {
+        // keyframes are deltas against nothing at all, not even a size
+        memset(display, 0, sizeof(*display));
+        watcher->keyframes++;
+    }
+    if (!delta_apply(display, data, msg->size)) {
+        printf("Error: malformed message\n");
+        return false;
+    }
+
+    if (screen) {
+        print_screen(msg, display);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = NULL;
+    uint32_t watched[MAX_WATCHED];
+    uint32_t watched_count = 0;
+    uint64_t limit = UINT64_MAX;
+    bool screen = false;
+
+    for (int32_t n = 1; n < argc; ++n) {
+        const char* arg = argv[n];
+        const char* value = n + 1 < argc ? argv[n + 1] : NULL;
+        if (arg[0] != '-') {
+            path = arg;
+            continue;
+        }
+        if (strcmp(arg, "--screen") == 0) {
+            screen = true;
+            continue;
+        }
+        if (!value) {
+            usage();
+            return EXIT_FAILURE;
+        }
+        n++;
+
+        if (strcmp(arg, "--instance") == 0 && watched_count < MAX_WATCHED) {
+            watched[watched_count++] = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--messages") == 0) {
+            limit = strtoull(value, NULL, 0);
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (!path || strlen(path) >= sizeof(addr.sun_path)) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, path);
+    if (watched_count == 0) {
+        watched[watched_count++] = STREAM_ALL;
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        printf("Error: failed to connect to %s\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return EXIT_FAILURE;
+    }
+    if (write(fd, watched, watched_count * sizeof(uint32_t)) !=
+        (ssize_t)(watched_count * sizeof(uint32_t))) {
+        printf("Error: failed to subscribe\n");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    struct watcher watcher = {0};
+    struct stream_message msg;
+    uint8_t data[DELTA_MAX_BYTES];
+    int32_t status = EXIT_SUCCESS;
+    while (watcher.messages < limit && read_full(fd, &msg, sizeof(msg))) {
+        if (msg.size > sizeof(data) || !read_full(fd, data, msg.size) ||
+            !handle(&watcher, &msg, data, screen)) {
+            status = EXIT_FAILURE;
+            break;
+        }
+    }
+    close(fd);
+
+    printf("%llu messages, %llu keyframes, %llu bytes, %.1f bytes per "
+           "message\n",
+           (unsigned long long)watcher.messages,
+           (unsigned long long)watcher.keyframes,
+           (unsigned long long)watcher.bytes,
+           watcher.messages
+               ? (double)watcher.bytes / (double)watcher.messages
+               : 0.0);
+    free(watcher.displays);
+    return status;
+}
@@ -15,6 +15,17 @@ pub fn build(b: *std.Build) void {
 
     b.installArtifact(exe);
 
+    // C ABI over the core, linked by c/tools/difftest.c
+    const lib = b.addStaticLibrary(.{
+        .name = "chip8zig",
+        .root_source_file = b.path("src/ffi.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    lib.linkLibC();
+
+    b.installArtifact(lib);
+
     const exe_unit_tests = b.addTest(.{
         .root_source_file = b.path("src/main.zig"),
         .target = target,
@@ -26,6 +37,17 @@ pub fn build(b: *std.Build) void {
 
     const run_exe_unit_tests = b.addRunArtifact(exe_unit_tests);
 
+    const lib_unit_tests = b.addTest(.{
+        .root_source_file = b.path("src/ffi.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+
+    lib_unit_tests.linkLibC();
+
+    const run_lib_unit_tests = b.addRunArtifact(lib_unit_tests);
+
     const test_step = b.step("test", "Run unit tests");
     test_step.dependOn(&run_exe_unit_tests.step);
+    test_step.dependOn(&run_lib_unit_tests.step);
 }
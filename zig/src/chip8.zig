@@ -74,7 +74,8 @@ pub const Cpu = struct {
     }
 
     pub fn loadRom(self: *Cpu, file_name: []const u8) !void {
-        const f = try std.fs.openFileAbsolute(file_name, .{});
+        // cwd().openFile takes absolute paths as well as relative ones
+        const f = try std.fs.cwd().openFile(file_name, .{});
         defer f.close();
 
         _ = try f.read(self.mem[app_memory_offset..]);
@@ -84,6 +85,21 @@ pub const Cpu = struct {
         }
     }
 
+    pub fn loadRomBytes(self: *Cpu, rom: []const u8) !void {
+        if (rom.len > max_rom_size) {
+            return error.RomTooBig;
+        }
+        @memcpy(self.mem[app_memory_offset..][0..rom.len], rom);
+    }
+
+    test loadRomBytes {
+        var cpu = Cpu.init(testRng());
+        try cpu.loadRomBytes(&[_]u8{ 0x12, 0x34 });
+        try std.testing.expectEqual(0x12, cpu.mem[app_memory_offset]);
+        try std.testing.expectEqual(0x34, cpu.mem[app_memory_offset + 1]);
+        try std.testing.expectError(error.RomTooBig, cpu.loadRomBytes(&[_]u8{0} ** (max_rom_size + 1)));
+    }
+
     pub fn cycle(self: *Cpu) void {
         // fetch
         const instr = Instr{
@@ -411,7 +427,7 @@ pub const Cpu = struct {
         } else {
             self.v[0xF] = 0;
         }
-        self.v[x] += self.v[y];
+        self.v[x] +%= self.v[y];
         self.pc += 2;
     }
 
@@ -425,6 +441,11 @@ pub const Cpu = struct {
         try std.testing.expectEqual(@as(u8, @intCast(0)), cpu.v[0xF]);
         try std.testing.expectEqual(@as(u8, @intCast(174)), cpu.v[x]);
         try std.testing.expectEqual(@as(u12, @intCast(app_memory_offset + 2)), cpu.pc);
+
+        cpu.v[2] = 200;
+        cpu.@"add Vx, Vy"(x, y);
+        try std.testing.expectEqual(@as(u8, @intCast(1)), cpu.v[0xF]);
+        try std.testing.expectEqual(@as(u8, @intCast(13)), cpu.v[x]);
     }
 
     // 8XY5
@@ -742,7 +763,7 @@ pub const Cpu = struct {
 
     // FX1E
     inline fn @"add I, Vx"(self: *Cpu, x: u4) void {
-        self.i += self.v[x];
+        self.i +%= self.v[x];
         self.pc += 2;
     }
 
@@ -757,7 +778,7 @@ pub const Cpu = struct {
 
     // FX29
     inline fn @"ld F, Vx"(self: *Cpu, x: u4) void {
-        self.i = self.v[x] * 5;
+        self.i = @as(u12, self.v[x]) * 5;
         self.pc += 2;
     }
 
@@ -798,10 +819,10 @@ pub const Cpu = struct {
     inline fn @"ld [I], Vx"(self: *Cpu, x: u4) void {
         const i = self.i;
 
-        for (0..(x + 1)) |j| {
+        for (0..(@as(usize, x) + 1)) |j| {
             self.mem[i + j] = self.v[j];
         }
-        self.i += (x + 1);
+        self.i +%= @as(u12, x) + 1;
         self.pc += 2;
     }
 
@@ -818,15 +839,20 @@ pub const Cpu = struct {
         try std.testing.expectEqual(cpu.v[1], cpu.mem[i + 1]);
         try std.testing.expectEqual(i + x + 1, cpu.i);
         try std.testing.expectEqual(@as(u12, @intCast(app_memory_offset + 2)), cpu.pc);
+
+        cpu.v[0xF] = testValue;
+        cpu.@"ld [I], Vx"(0xF);
+        try std.testing.expectEqual(testValue, cpu.mem[i + x + 1 + 0xF]);
+        try std.testing.expectEqual(i + x + 1 + 16, cpu.i);
     }
 
     // FX65
     inline fn @"ld Vx [I]"(self: *Cpu, x: u4) void {
         const i = self.i;
-        for (0..(x + 1)) |j| {
+        for (0..(@as(usize, x) + 1)) |j| {
             self.v[j] = self.mem[i + j];
         }
-        self.i += (x + 1);
+        self.i +%= @as(u12, x) + 1;
         self.pc += 2;
     }
 
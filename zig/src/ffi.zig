@@ -0,0 +1,97 @@
+const std = @import("std");
+const chip8 = @import("chip8.zig");
+
+// C ABI over the core for tools written in C, see c/include/zigcore.h
+
+pub const State = extern struct {
+    v: [16]u8,
+    stack: [16]u16,
+    i: u16,
+    pc: u16,
+    sp: u16,
+    dt: u8,
+    st: u8,
+};
+
+const Core = struct {
+    pcg: std.rand.Pcg,
+    cpu: chip8.Cpu,
+};
+
+export fn chip8_zig_create(seed: u64) ?*Core {
+    const core = std.heap.c_allocator.create(Core) catch return null;
+    core.pcg = std.rand.Pcg.init(seed);
+    core.cpu = chip8.Cpu.init(core.pcg.random());
+    return core;
+}
+
+export fn chip8_zig_destroy(core: *Core) void {
+    std.heap.c_allocator.destroy(core);
+}
+
+export fn chip8_zig_load(core: *Core, rom: [*]const u8, len: usize) bool {
+    core.cpu = chip8.Cpu.init(core.pcg.random());
+    core.cpu.loadRomBytes(rom[0..len]) catch return false;
+    return true;
+}
+
+export fn chip8_zig_step(core: *Core) void {
+    core.cpu.cycle();
+}
+
+export fn chip8_zig_tick(core: *Core) void {
+    core.cpu.updateTimers();
+}
+
+export fn chip8_zig_state(core: *const Core, out: *State) void {
+    const cpu = &core.cpu;
+    out.v = cpu.v;
+    for (cpu.stack, 0..) |entry, n| {
+        out.stack[n] = entry;
+    }
+    out.i = cpu.i;
+    out.pc = cpu.pc;
+    out.sp = cpu.sp;
+    out.dt = cpu.dt;
+    out.st = cpu.st;
+}
+
+export fn chip8_zig_mem(core: *const Core) [*]const u8 {
+    return &core.cpu.mem;
+}
+
+// one display row, packed like the C core: leftmost pixel in the top bit
+export fn chip8_zig_row(core: *const Core, y: u32) u64 {
+    const width: usize = @intCast(chip8.display_width);
+    const height: usize = @intCast(chip8.display_height);
+    const base = (y % height) * width;
+    var row: u64 = 0;
+    for (core.cpu.fb[base .. base + width]) |pixel| {
+        row = (row << 1) | @intFromBool(pixel != 0);
+    }
+    return row;
+}
+
+export fn chip8_zig_set_v(core: *Core, x: u8, value: u8) void {
+    core.cpu.v[x & 0xF] = value;
+}
+
+export fn chip8_zig_set_key(core: *Core, key: u8, pressed: bool) void {
+    core.cpu.key[key & 0xF] = @intFromBool(pressed);
+}
+
+test chip8_zig_state {
+    const core = chip8_zig_create(0).?;
+    defer chip8_zig_destroy(core);
+
+    const rom = [_]u8{ 0x61, 0x2A, 0xD0, 0x05 };
+    try std.testing.expect(chip8_zig_load(core, &rom, rom.len));
+    chip8_zig_step(core);
+    chip8_zig_step(core);
+
+    var state: State = undefined;
+    chip8_zig_state(core, &state);
+    try std.testing.expectEqual(0x2A, state.v[1]);
+    try std.testing.expectEqual(0x204, state.pc);
+    try std.testing.expectEqual(0xF000000000000000, chip8_zig_row(core, 0));
+}